@@ -32,6 +32,8 @@
 #include "scene/uuid.h"
 #include "ai/world_state.h"
 #include "ai/actions/ai_action_follow.h"
+#include "jobs/frame_arena.h"
+#include "jobs/task_manager.h"
 
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 700;
@@ -68,6 +70,8 @@ namespace surfacepp {
             window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "surfacepp Editor", nullptr, nullptr);
             assert(window != nullptr);
             glfwMakeContextCurrent(window);
+            // GPU uploads from the worker tasks are posted back to the thread owning the context
+            TaskManager::GetInstance().BindMainThread();
 
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -220,6 +224,9 @@ namespace surfacepp {
                 deltaTime = currentFrame - lastFrame;
                 lastFrame = currentFrame;
 
+                FrameArena::BeginFrame();
+                TaskManager::GetInstance().BeginFrame();
+                TaskManager::GetInstance().ExecuteMainThreadTasks();
                 this->OnUpdate(deltaTime);
                 this->OnOpenglRender(deltaTime);
 //                this->OnImGuiRender(deltaTime);
@@ -0,0 +1,314 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the TaskManager. Results are written as JSON to the file given as the first argument, or to stdout.
+// Run the same build before and after a scheduler change and compare the files
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jobs/task_allocator.h"
+#include "jobs/task_manager.h"
+#include "locks/lock_stats.h"
+#include "log.h"
+
+namespace surfacepp::bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Collected latencies of one benchmark in nanoseconds
+    class LatencySamples
+    {
+    public:
+        void Add(Clock::duration duration)
+        {
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        }
+
+        // Percentile in [0, 1]
+        int64_t GetPercentile(double percentile)
+        {
+            if(samples.empty())
+                return 0;
+            std::sort(samples.begin(), samples.end());
+            return samples[static_cast<size_t>(percentile * static_cast<double>(samples.size() - 1))];
+        }
+
+        void WriteJson(std::ostream& stream)
+        {
+            stream << "{\"samples\":" << samples.size()
+                   << ",\"p50_ns\":" << GetPercentile(0.5)
+                   << ",\"p90_ns\":" << GetPercentile(0.9)
+                   << ",\"p99_ns\":" << GetPercentile(0.99)
+                   << ",\"max_ns\":" << GetPercentile(1.0) << "}";
+        }
+
+    private:
+        std::vector<int64_t> samples;
+    };
+
+    double ToSeconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    // Submits empty tasks from the main thread, then from a worker, and waits until all of them are done
+    void RunEnqueueThroughput(TaskManager& manager, std::ostream& stream)
+    {
+        constexpr unsigned kTasksCount = 200000;
+
+        // Waiting runs the tasks meanwhile, so the worker measuring it doesn't hold the only worker of the pool
+        auto measure = [&manager]
+        {
+            std::vector<std::shared_ptr<TaskHandleBase>> handles;
+            handles.reserve(kTasksCount);
+            const auto start = Clock::now();
+            for(unsigned i = 0; i < kTasksCount; ++i)
+                handles.push_back(manager.RunTask([] {}));
+            const auto enqueue_end = Clock::now();
+
+            manager.WhenAll(handles)->WaitForTaskResult();
+            const auto end = Clock::now();
+
+            return std::make_pair(kTasksCount / ToSeconds(enqueue_end - start), kTasksCount / ToSeconds(end - start));
+        };
+
+        const auto [external_enqueue_rate, external_total_rate] = measure();
+        // Submissions from a worker go to its local deque
+        const auto [worker_enqueue_rate, worker_total_rate] = manager.RunAndWaitForTask(measure);
+
+        stream << "\"enqueue_throughput\":{\"tasks\":" << kTasksCount
+               << ",\"external_enqueue_per_s\":" << external_enqueue_rate
+               << ",\"external_completed_per_s\":" << external_total_rate
+               << ",\"worker_enqueue_per_s\":" << worker_enqueue_rate
+               << ",\"worker_completed_per_s\":" << worker_total_rate << "}";
+    }
+
+    // Heap allocations of the task allocator while tasks are submitted and finished after a warm-up. Should be zero
+    void RunSteadyStateAllocations(TaskManager& manager, std::ostream& stream)
+    {
+        constexpr unsigned kTasksCount = 50000;
+
+        // The counter outlives both runs, a worker could still be returning from the last task of the first one
+        std::atomic_uint done_count = 0;
+        unsigned submitted_count = 0;
+        auto run_tasks = [&manager, &done_count, &submitted_count]
+        {
+            for(unsigned i = 0; i < kTasksCount; ++i)
+                manager.RunTask([&done_count] { done_count.fetch_add(1, std::memory_order_relaxed); });
+            submitted_count += kTasksCount;
+            while(done_count.load(std::memory_order_acquire) != submitted_count)
+                std::this_thread::yield();
+        };
+
+        // Fills the thread caches and the shared pool
+        run_tasks();
+        const uint64_t heap_allocations_start = TaskAllocator::GetHeapAllocationsCount();
+        run_tasks();
+        const uint64_t heap_allocations_count = TaskAllocator::GetHeapAllocationsCount() - heap_allocations_start;
+
+        stream << "\"steady_state_allocations\":{\"tasks\":" << kTasksCount
+               << ",\"heap_allocations\":" << heap_allocations_count << "}";
+    }
+
+    // Spawns a batch of small tasks and waits for all of them with WhenAll
+    void RunFanOutFanIn(TaskManager& manager, std::ostream& stream)
+    {
+        constexpr unsigned kIterationsCount = 2000;
+        constexpr unsigned kFanOut = 64;
+
+        LatencySamples latencies;
+        std::vector<std::shared_ptr<TaskHandleBase>> handles;
+        handles.reserve(kFanOut);
+        for(unsigned iteration = 0; iteration < kIterationsCount; ++iteration)
+        {
+            handles.clear();
+            const auto start = Clock::now();
+            for(unsigned i = 0; i < kFanOut; ++i)
+                handles.push_back(manager.RunTask([i] { return i * i; }));
+            manager.WhenAll(handles)->WaitForTaskResult();
+            latencies.Add(Clock::now() - start);
+        }
+
+        stream << "\"fan_out_fan_in\":{\"fan_out\":" << kFanOut << ",\"latency\":";
+        latencies.WriteJson(stream);
+        stream << "}";
+    }
+
+    // Time between submitting a trivial task and getting its result back
+    void RunRoundTrip(TaskManager& manager, std::ostream& stream)
+    {
+        constexpr unsigned kIterationsCount = 20000;
+
+        LatencySamples latencies;
+        for(unsigned i = 0; i < kIterationsCount; ++i)
+        {
+            const auto start = Clock::now();
+            manager.RunAndWaitForTask([i] { return i + 1; });
+            latencies.Add(Clock::now() - start);
+        }
+
+        stream << "\"round_trip\":{\"latency\":";
+        latencies.WriteJson(stream);
+        stream << "}";
+    }
+
+    // Keeps the workers busy with high priority tasks and measures how long VeryLow tasks wait meanwhile
+    void RunPriorityStarvation(TaskManager& manager, std::ostream& stream)
+    {
+        constexpr auto kDuration = std::chrono::milliseconds(2000);
+        constexpr unsigned kLowPriorityTasksCount = 100;
+
+        const unsigned load_tasks_count = 2 * std::max(1u, std::thread::hardware_concurrency());
+
+        std::atomic_bool is_loaded = true;
+        std::atomic_uint running_load_tasks = load_tasks_count;
+        std::atomic_uint64_t high_priority_done = 0;
+
+        // Every high priority task queues its successor, so the load stays until is_loaded is reset
+        std::function<void()> busy_task = [&]
+        {
+            const auto spin_end = Clock::now() + std::chrono::microseconds(50);
+            while(Clock::now() < spin_end) {}
+            high_priority_done.fetch_add(1, std::memory_order_relaxed);
+            if(is_loaded.load(std::memory_order_relaxed))
+                manager.RunTask(TaskPriority::High, busy_task);
+            else
+                running_load_tasks.fetch_sub(1, std::memory_order_release);
+        };
+
+        for(unsigned i = 0; i < load_tasks_count; ++i)
+            manager.RunTask(TaskPriority::High, busy_task);
+
+        std::vector<std::shared_ptr<TaskHandle<Clock::time_point>>> low_priority_handles;
+        std::vector<Clock::time_point> submit_times;
+        const auto start = Clock::now();
+        for(unsigned i = 0; i < kLowPriorityTasksCount && Clock::now() - start < kDuration; ++i)
+        {
+            submit_times.push_back(Clock::now());
+            low_priority_handles.push_back(manager.RunTask(TaskPriority::VeryLow, [] { return Clock::now(); }));
+            std::this_thread::sleep_for(kDuration / kLowPriorityTasksCount);
+        }
+
+        // Count only what finished under load, then let the rest drain
+        size_t finished_under_load = 0;
+        LatencySamples latencies;
+        for(size_t i = 0; i < low_priority_handles.size(); ++i)
+        {
+            if(!low_priority_handles[i]->HasTaskResult())
+                continue;
+            ++finished_under_load;
+            latencies.Add(low_priority_handles[i]->GetTaskResult() - submit_times[i]);
+        }
+
+        is_loaded.store(false, std::memory_order_relaxed);
+        for(auto& handle : low_priority_handles)
+            handle->WaitForTaskResult();
+        // Load tasks refer to the locals of this function
+        while(running_load_tasks.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+
+        stream << "\"priority_starvation\":{\"load_tasks\":" << load_tasks_count
+               << ",\"high_priority_done\":" << high_priority_done.load(std::memory_order_relaxed)
+               << ",\"low_priority_submitted\":" << low_priority_handles.size()
+               << ",\"low_priority_finished_under_load\":" << finished_under_load
+               << ",\"low_priority_latency\":";
+        latencies.WriteJson(stream);
+        stream << "}";
+    }
+
+    // Contention of the scheduler locks during all the benchmarks, the most waited for go first
+    void WriteLockStats(std::ostream& stream)
+    {
+        stream << "\"locks\":[";
+        const auto report = LockStats::GetReport();
+        for(size_t i = 0; i < report.size(); ++i)
+        {
+            const auto& entry = report[i];
+            stream << (i == 0 ? "\n" : ",\n")
+                   << "{\"name\":\"" << entry.lock_name << "\""
+                   << ",\"acquisitions\":" << entry.acquisitions_count
+                   << ",\"contended\":" << entry.contended_count
+                   << ",\"failed_try_acquisitions\":" << entry.failed_try_acquisitions_count
+                   << ",\"spins\":" << entry.spins_count
+                   << ",\"wait_ms\":" << std::chrono::duration<double, std::milli>(entry.wait_time).count()
+                   << ",\"hold_ms\":" << std::chrono::duration<double, std::milli>(entry.hold_time).count() << "}";
+        }
+        stream << "]";
+    }
+
+    void RunAll(std::ostream& stream)
+    {
+        auto& manager = TaskManager::GetInstance();
+        LockStats::SetEnabled(true);
+
+        // Starts the workers, so the first benchmark doesn't measure thread creation
+        manager.ParallelFor(0u, std::max(1u, std::thread::hardware_concurrency()) * 4, 1u, [](unsigned) {});
+
+        stream << "{\"hardware_concurrency\":" << std::thread::hardware_concurrency() << ",\n";
+        RunEnqueueThroughput(manager, stream);
+        stream << ",\n";
+        RunSteadyStateAllocations(manager, stream);
+        stream << ",\n";
+        RunFanOutFanIn(manager, stream);
+        stream << ",\n";
+        RunRoundTrip(manager, stream);
+        stream << ",\n";
+        RunPriorityStarvation(manager, stream);
+
+        const auto stats = manager.GetStats();
+        stream << ",\n\"stats\":{\"workers\":" << stats.started_workers_count
+               << ",\"steals\":" << stats.steals_count
+               << ",\"idle_ms\":" << std::chrono::duration<double, std::milli>(stats.idle_time).count() << "}";
+        stream << ",\n";
+        WriteLockStats(stream);
+        stream << "\n}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 2 || (argc == 2 && argv[1][0] == '-'))
+    {
+        std::cerr << "Usage: " << argv[0] << " [output.json]" << std::endl;
+        return 2;
+    }
+
+    // Per-task debug messages would measure stdio instead of the scheduler. The rest goes to stderr, so stdout stays valid JSON
+    SetLogLevelFilter(kSurfaceppLogLevelErr | kSurfaceppLogLevelWarn);
+    SetLogOutput(stderr);
+
+    if(argc == 2)
+    {
+        std::ofstream file(argv[1]);
+        if(!file)
+        {
+            std::cerr << "Can't open " << argv[1] << std::endl;
+            return 1;
+        }
+        surfacepp::bench::RunAll(file);
+        return 0;
+    }
+
+    surfacepp::bench::RunAll(std::cout);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,395 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput and tail latency of the locks under contention. Every lock is run for all the combinations of the thread counts,
+// critical section lengths and, for the reader-writer locks, shares of reads. Results are written as JSON to the file given
+// as the first argument, or to stdout. Run the same build before and after a lock change and compare the files
+//
+// Options override the defaults, lists are comma separated:
+//   --threads=2,4,8          counts of the contending threads
+//   --critical-section=8,128 CPU pauses inside of the lock
+//   --read-percent=0,90      share of the shared acquisitions, only for the locks with AcquireShared
+//   --duration-ms=200        time of one run
+//   --locks=SpinLock,McsLock names of the locks to run, all by default
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "locks/backoff_spin_lock.h"
+#include "locks/hybrid_mutex.h"
+#include "locks/lock_concepts.h"
+#include "locks/mcs_lock.h"
+#include "locks/reentrant_lock.h"
+#include "locks/rw_spin_lock.h"
+#include "locks/scoped_lock.h"
+#include "locks/scoped_shared_lock.h"
+#include "locks/spin_backoff.h"
+#include "locks/spin_lock.h"
+#include "locks/ticket_lock.h"
+
+namespace surfacepp::bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Wait for the lock is timed for every kLatencySampleInterval acquisition, so the clock doesn't dominate short sections
+    constexpr uint64_t kLatencySampleInterval = 8;
+    constexpr size_t kMaxLatencySamplesPerThread = 1 << 16;
+
+    struct Options
+    {
+        std::vector<unsigned> threads_counts = { 2, 4, 8, 16, 64 };
+        std::vector<unsigned> critical_section_pauses = { 8, 128 };
+        std::vector<unsigned> read_percents = { 0, 90 };
+        std::chrono::milliseconds duration = std::chrono::milliseconds(200);
+        std::vector<std::string> lock_names;
+        std::string output_path;
+
+        bool IsLockSelected(std::string_view lock_class_name) const
+        {
+            return lock_names.empty() || std::find(lock_names.begin(), lock_names.end(), lock_class_name) != lock_names.end();
+        }
+    };
+
+    struct RunParameters
+    {
+        unsigned threads_count = 0;
+        unsigned critical_section_pauses = 0;
+        unsigned read_percent = 0;
+    };
+
+    struct RunResult
+    {
+        uint64_t acquisitions_count = 0;
+        // Writes not seen by the other threads, and reads seeing a half-done write. Both should be zero
+        uint64_t lost_updates_count = 0;
+        uint64_t torn_reads_count = 0;
+        std::vector<int64_t> wait_samples_ns;
+    };
+
+    // Data guarded by the lock. Writers update both fields, readers check they are equal
+    struct ProtectedData
+    {
+        uint64_t first = 0;
+        uint64_t second = 0;
+    };
+
+    void Pause(unsigned pauses_count)
+    {
+        for(unsigned pause = 0; pause < pauses_count; ++pause)
+            CpuRelax();
+    }
+
+    template<Lockable LockClass>
+    RunResult MeasureRun(const RunParameters& parameters, std::chrono::milliseconds duration)
+    {
+        LockClass lock("BenchLock");
+        ProtectedData data;
+        std::atomic_bool is_started = false;
+        std::atomic_bool is_stopped = false;
+
+        std::vector<RunResult> thread_results(parameters.threads_count);
+        std::vector<std::thread> threads;
+        for(unsigned thread_index = 0; thread_index < parameters.threads_count; ++thread_index)
+        {
+            threads.emplace_back([&, thread_index]
+            {
+                RunResult& result = thread_results[thread_index];
+                result.wait_samples_ns.reserve(kMaxLatencySamplesPerThread);
+                // Cheap generator, so threads don't share the state of std::rand
+                uint32_t random_state = thread_index * 2654435761u + 1;
+
+                while(!is_started.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                uint64_t writes_count = 0;
+                while(!is_stopped.load(std::memory_order_relaxed))
+                {
+                    random_state = random_state * 1664525u + 1013904223u;
+                    const bool is_read = (random_state >> 8) % 100 < parameters.read_percent;
+                    const bool is_sampled = result.acquisitions_count % kLatencySampleInterval == 0
+                        && result.wait_samples_ns.size() < kMaxLatencySamplesPerThread;
+                    const auto wait_start = is_sampled ? Clock::now() : Clock::time_point();
+
+                    if constexpr(SharedLockable<LockClass>)
+                    {
+                        if(is_read)
+                        {
+                            ScopedSharedLock scopeLock(lock);
+                            if(is_sampled)
+                                result.wait_samples_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wait_start).count());
+                            if(data.first != data.second)
+                                ++result.torn_reads_count;
+                            Pause(parameters.critical_section_pauses);
+                            ++result.acquisitions_count;
+                            continue;
+                        }
+                    }
+
+                    ScopedLock scopeLock(lock);
+                    if(is_sampled)
+                        result.wait_samples_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wait_start).count());
+                    if(is_read)
+                    {
+                        if(data.first != data.second)
+                            ++result.torn_reads_count;
+                        Pause(parameters.critical_section_pauses);
+                    }
+                    else
+                    {
+                        ++data.first;
+                        Pause(parameters.critical_section_pauses);
+                        ++data.second;
+                        ++writes_count;
+                    }
+                    ++result.acquisitions_count;
+                }
+                // Kept in the lost counter until the totals are compared
+                result.lost_updates_count = writes_count;
+            });
+        }
+
+        is_started.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(duration);
+        is_stopped.store(true, std::memory_order_relaxed);
+        for(auto& thread : threads)
+            thread.join();
+
+        RunResult total;
+        uint64_t writes_count = 0;
+        for(auto& result : thread_results)
+        {
+            total.acquisitions_count += result.acquisitions_count;
+            total.torn_reads_count += result.torn_reads_count;
+            writes_count += result.lost_updates_count;
+            total.wait_samples_ns.insert(total.wait_samples_ns.end(), result.wait_samples_ns.begin(), result.wait_samples_ns.end());
+        }
+        total.lost_updates_count = writes_count - data.second;
+        return total;
+    }
+
+    // Percentile in [0, 1] of the sorted samples
+    int64_t GetPercentile(const std::vector<int64_t>& sorted_samples, double percentile)
+    {
+        if(sorted_samples.empty())
+            return 0;
+        return sorted_samples[static_cast<size_t>(percentile * static_cast<double>(sorted_samples.size() - 1))];
+    }
+
+    class LocksBenchmark
+    {
+    public:
+        LocksBenchmark(const Options& options, std::ostream& stream)
+        : options(options), stream(stream)
+        {}
+
+        template<Lockable LockClass>
+        void Run(const char* lock_class_name)
+        {
+            if(!options.IsLockSelected(lock_class_name))
+                return;
+
+            for(const unsigned threads_count : options.threads_counts)
+            {
+                for(const unsigned critical_section_pauses : options.critical_section_pauses)
+                {
+                    // Exclusive locks take every read exclusively too, so the read share changes nothing for them
+                    if constexpr(SharedLockable<LockClass>)
+                    {
+                        for(const unsigned read_percent : options.read_percents)
+                            RunOnce<LockClass>(lock_class_name, { threads_count, critical_section_pauses, read_percent });
+                    }
+                    else
+                        RunOnce<LockClass>(lock_class_name, { threads_count, critical_section_pauses, 0 });
+                }
+            }
+        }
+
+        void Begin()
+        {
+            stream << "{\"hardware_concurrency\":" << std::thread::hardware_concurrency()
+                   << ",\"duration_ms\":" << options.duration.count()
+                   << ",\"latency_sample_interval\":" << kLatencySampleInterval
+                   << ",\"runs\":[";
+        }
+
+        void End()
+        {
+            stream << "\n]}\n";
+        }
+
+        bool HasFailures() const
+        {
+            return has_failures;
+        }
+
+    private:
+        template<Lockable LockClass>
+        void RunOnce(const char* lock_class_name, const RunParameters& parameters)
+        {
+            RunResult result = MeasureRun<LockClass>(parameters, options.duration);
+            std::sort(result.wait_samples_ns.begin(), result.wait_samples_ns.end());
+
+            if(result.lost_updates_count != 0 || result.torn_reads_count != 0)
+            {
+                std::cerr << lock_class_name << " with " << parameters.threads_count << " threads lost " << result.lost_updates_count
+                          << " updates, saw " << result.torn_reads_count << " torn reads" << std::endl;
+                has_failures = true;
+            }
+
+            stream << (is_first_run ? "\n" : ",\n")
+                   << "{\"lock\":\"" << lock_class_name << "\""
+                   << ",\"threads\":" << parameters.threads_count
+                   << ",\"critical_section_pauses\":" << parameters.critical_section_pauses
+                   << ",\"read_percent\":" << parameters.read_percent
+                   << ",\"acquisitions_per_s\":" << result.acquisitions_count / std::chrono::duration<double>(options.duration).count()
+                   << ",\"lost_updates\":" << result.lost_updates_count
+                   << ",\"torn_reads\":" << result.torn_reads_count
+                   << ",\"wait\":{\"samples\":" << result.wait_samples_ns.size()
+                   << ",\"p50_ns\":" << GetPercentile(result.wait_samples_ns, 0.5)
+                   << ",\"p99_ns\":" << GetPercentile(result.wait_samples_ns, 0.99)
+                   << ",\"p999_ns\":" << GetPercentile(result.wait_samples_ns, 0.999)
+                   << ",\"max_ns\":" << GetPercentile(result.wait_samples_ns, 1.0) << "}}";
+            is_first_run = false;
+        }
+
+        const Options& options;
+        std::ostream& stream;
+        bool is_first_run = true;
+        bool has_failures = false;
+    };
+
+    bool RunAll(const Options& options, std::ostream& stream)
+    {
+        LocksBenchmark benchmark(options, stream);
+        benchmark.Begin();
+        benchmark.Run<SpinLock>("SpinLock");
+        benchmark.Run<BackoffSpinLock>("BackoffSpinLock");
+        benchmark.Run<TicketLock>("TicketLock");
+        benchmark.Run<McsLock>("McsLock");
+        benchmark.Run<HybridMutex>("HybridMutex");
+        benchmark.Run<ReentrantLock>("ReentrantLock");
+        benchmark.Run<RWSpinLock>("RWSpinLock");
+        benchmark.End();
+        return !benchmark.HasFailures();
+    }
+
+    bool ParseList(std::string_view value, std::vector<std::string>& result)
+    {
+        result.clear();
+        while(!value.empty())
+        {
+            const size_t separator = value.find(',');
+            result.emplace_back(value.substr(0, separator));
+            if(separator == std::string_view::npos)
+                break;
+            value.remove_prefix(separator + 1);
+        }
+        return !result.empty();
+    }
+
+    bool ParseList(std::string_view value, std::vector<unsigned>& result)
+    {
+        std::vector<std::string> items;
+        if(!ParseList(value, items))
+            return false;
+
+        result.clear();
+        for(const auto& item : items)
+        {
+            char* end = nullptr;
+            const unsigned long number = std::strtoul(item.c_str(), &end, 10);
+            if(item.empty() || *end != '\0')
+                return false;
+            result.push_back(static_cast<unsigned>(number));
+        }
+        return true;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const std::string_view argument = argv[i];
+            if(!argument.starts_with("--"))
+            {
+                options.output_path = argument;
+                continue;
+            }
+
+            const size_t separator = argument.find('=');
+            if(separator == std::string_view::npos)
+                return false;
+            const std::string_view name = argument.substr(2, separator - 2);
+            const std::string_view value = argument.substr(separator + 1);
+
+            bool is_parsed = false;
+            if(name == "threads")
+                is_parsed = ParseList(value, options.threads_counts);
+            else if(name == "critical-section")
+                is_parsed = ParseList(value, options.critical_section_pauses);
+            else if(name == "read-percent")
+                is_parsed = ParseList(value, options.read_percents)
+                    && std::all_of(options.read_percents.begin(), options.read_percents.end(), [](unsigned percent) { return percent <= 100; });
+            else if(name == "locks")
+                is_parsed = ParseList(value, options.lock_names);
+            else if(name == "duration-ms")
+            {
+                std::vector<unsigned> durations;
+                is_parsed = ParseList(value, durations) && durations.size() == 1;
+                if(is_parsed)
+                    options.duration = std::chrono::milliseconds(durations.front());
+            }
+
+            if(!is_parsed)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    surfacepp::bench::Options options;
+    if(!surfacepp::bench::ParseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--threads=2,4] [--critical-section=8,128] [--read-percent=0,90]"
+                  << " [--duration-ms=200] [--locks=SpinLock,RWSpinLock] [output.json]" << std::endl;
+        return 2;
+    }
+
+    bool is_passed = false;
+    if(!options.output_path.empty())
+    {
+        std::ofstream file(options.output_path);
+        if(!file)
+        {
+            std::cerr << "Can't open " << options.output_path << std::endl;
+            return 1;
+        }
+        is_passed = surfacepp::bench::RunAll(options, file);
+    }
+    else
+        is_passed = surfacepp::bench::RunAll(options, std::cout);
+
+    return is_passed ? 0 : 1;
+}
\ No newline at end of file
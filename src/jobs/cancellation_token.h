@@ -0,0 +1,41 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "task_allocator.h"
+
+// Flag shared between the code which submits speculative work and the tasks doing it. Copies of the token share the same flag.
+// Queued tasks with a cancelled token are dropped without running, long tasks should check IsCancelled themselves
+class CancellationToken
+{
+public:
+    CancellationToken()
+            : is_cancelled(std::allocate_shared<std::atomic_bool>(TaskPoolAllocator<std::atomic_bool>(), false)) {}
+
+    void Cancel() const
+    {
+        is_cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const
+    {
+        return is_cancelled->load(std::memory_order_relaxed);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> is_cancelled;
+};
\ No newline at end of file
@@ -0,0 +1,183 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "ring_buffer.h"
+#include "task_manager.h"
+#include "locks/scoped_lock.h"
+#include "locks/spin_lock.h"
+#include "log.h"
+
+// Bounded queue of messages between the systems running on different threads. Items are either polled with TryPop,
+// or handed to a consumer set with SetConsumer: the first push into an idle channel schedules a task on the TaskManager,
+// which drains the channel. Only one consumer task is queued or running at a time, so the consumer is never called concurrently
+template<class ItemType, class RingBufferClass>
+class Channel
+{
+public:
+    using consumer_func = std::function<void(ItemType&&)>;
+
+    explicit Channel(size_t capacity)
+    : items(capacity), consumer_lock("ChannelConsumerLock")
+    {}
+
+    // Waits for the consumer task. Producers have to be stopped before
+    ~Channel()
+    {
+        WaitForConsumer();
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Items are passed to the consumer func by the tasks of the manager. Should be set before the first push
+    void SetConsumer(TaskManager& manager, TaskPriority priority, consumer_func func)
+    {
+        consumer_manager = &manager;
+        consumer_priority = priority;
+        consumer = std::move(func);
+        if(!items.IsEmpty())
+            ScheduleConsumer();
+    }
+
+    // Returns false, if the channel is full
+    template<class ValueType>
+    bool TryPush(ValueType&& value)
+    {
+        if(!items.TryPush(std::forward<ValueType>(value)))
+            return false;
+
+        if(consumer)
+        {
+            // Pairs with the fence of RunConsumer: either the consumer sees the item, or this push sees the consumer idle
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!is_consumer_scheduled.load(std::memory_order_relaxed))
+                ScheduleConsumer();
+        }
+        return true;
+    }
+
+    // Polls the channel, when there is no consumer
+    std::optional<ItemType> TryPop()
+    {
+        return items.TryPop();
+    }
+
+    bool IsEmpty() const
+    {
+        return items.IsEmpty();
+    }
+
+    size_t GetCapacity() const
+    {
+        return items.GetCapacity();
+    }
+
+    // Waits until the scheduled consumer task is done, helping the workers meanwhile. Items pushed later schedule a new one
+    void WaitForConsumer()
+    {
+        // A finishing consumer task may schedule the next one, so the handle is read again until none is left
+        while(running_consumers_count.load(std::memory_order_acquire) != 0)
+        {
+            std::shared_ptr<TaskHandle<void>> handle;
+            {
+                ScopedLock scopeConsumerLock(consumer_lock);
+                handle = consumer_handle;
+            }
+            if(handle && !handle->HasTaskResult())
+                handle->WaitForTaskResult();
+            else
+                // The scheduling producer hasn't stored the new handle yet
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    void ScheduleConsumer()
+    {
+        bool is_scheduled = false;
+        if(!is_consumer_scheduled.compare_exchange_strong(is_scheduled, true, std::memory_order_acq_rel))
+            return;
+
+        running_consumers_count.fetch_add(1, std::memory_order_relaxed);
+        ScopedLock scopeConsumerLock(consumer_lock);
+        consumer_handle = consumer_manager->RunTask(consumer_priority, [this] { RunConsumer(); });
+    }
+
+    void RunConsumer()
+    {
+        // Leaves the worker after a full channel of items, so a busy channel doesn't hold it forever
+        for(size_t count = 0; count < items.GetCapacity(); ++count)
+        {
+            std::optional<ItemType> item = items.TryPop();
+            if(!item.has_value())
+                break;
+            ConsumeItem(std::move(*item));
+        }
+
+        // Release passes the consumer side of the ring buffer to the next consumer task
+        is_consumer_scheduled.store(false, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Items pushed while the consumer was finishing didn't schedule it
+        if(!items.IsEmpty())
+            ScheduleConsumer();
+        running_consumers_count.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Failed item is dropped, the rest of the channel is still consumed
+    void ConsumeItem(ItemType&& item)
+    {
+        try
+        {
+            consumer(std::move(item));
+        }
+        catch (const std::exception& e)
+        {
+            log_err("Exception in a channel consumer: %s", e.what());
+        }
+        catch (...)
+        {
+            log_err("Exception in a channel consumer");
+        }
+    }
+
+    RingBufferClass items;
+
+    TaskManager* consumer_manager = nullptr;
+    TaskPriority consumer_priority = TaskPriority::Normal;
+    consumer_func consumer;
+
+    std::atomic_bool is_consumer_scheduled = false;
+    std::atomic_size_t running_consumers_count = 0;
+    // Handle of the last scheduled consumer task, to wait for it
+    SpinLock consumer_lock;
+    std::shared_ptr<TaskHandle<void>> consumer_handle;
+};
+
+// Channel with one producer thread
+template<class ItemType>
+using SpscChannel = Channel<ItemType, SpscRingBuffer<ItemType>>;
+
+// Channel with any number of producer threads
+template<class ItemType>
+using MpscChannel = Channel<ItemType, MpscRingBuffer<ItemType>>;
\ No newline at end of file
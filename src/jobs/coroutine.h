@@ -0,0 +1,283 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include "task_manager.h"
+
+namespace surfacepp
+{
+    template<class ResultType = void>
+    class Task;
+
+    namespace detail
+    {
+        template<class ResultType>
+        class PromiseResult
+        {
+        public:
+            template<class Value>
+            void return_value(Value&& value)
+            {
+                result.emplace(std::forward<Value>(value));
+            }
+
+            ResultType TakeResult()
+            {
+                return std::move(*result);
+            }
+
+        protected:
+            std::optional<ResultType> result;
+        };
+
+        template<>
+        class PromiseResult<void>
+        {
+        public:
+            void return_void() {}
+
+            void TakeResult() {}
+        };
+    }
+
+    // Coroutine task. It starts suspended and runs when it's awaited by another coroutine or started with StartCoroutine.
+    // Inside of it TaskHandle objects can be awaited with co_await, the coroutine is resumed on a worker when the handle is finished
+    template<class ResultType>
+    class Task
+    {
+    public:
+        class promise_type : public detail::PromiseResult<ResultType>
+        {
+        public:
+            Task get_return_object()
+            {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            auto final_suspend() noexcept
+            {
+                struct FinalAwaiter
+                {
+                    bool await_ready() noexcept { return false; }
+
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> coroutine) noexcept
+                    {
+                        auto& promise = coroutine.promise();
+                        if(promise.continuation)
+                            return promise.continuation;
+
+                        // Started with StartCoroutine, nobody owns the frame except the promise itself
+                        if(promise.detached_handle)
+                            promise.FinishDetached(coroutine);
+                        return std::noop_coroutine();
+                    }
+
+                    void await_resume() noexcept {}
+                };
+
+                return FinalAwaiter{};
+            }
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+
+            ResultType GetResult()
+            {
+                if(exception)
+                    std::rethrow_exception(exception);
+                return this->TakeResult();
+            }
+
+            // Coroutine awaiting this one, resumed right after this one is finished
+            std::coroutine_handle<> continuation;
+            // Handle of the coroutine started with StartCoroutine
+            std::shared_ptr<TaskHandle<ResultType>> detached_handle;
+
+        private:
+            void FinishDetached(std::coroutine_handle<promise_type> coroutine) noexcept
+            {
+                auto handle = std::move(detached_handle);
+                if(exception)
+                {
+                    // Same as an exception escaping a regular task, the waiter of the handle rethrows it
+                    auto coroutine_exception = std::move(exception);
+                    coroutine.destroy();
+                    handle->SetTaskException(std::move(coroutine_exception));
+                    return;
+                }
+
+                if constexpr (std::is_void_v<ResultType>)
+                {
+                    coroutine.destroy();
+                    handle->MarkFinished();
+                }
+                else
+                {
+                    ResultType result = this->TakeResult();
+                    coroutine.destroy();
+                    handle->SetTaskResult(std::move(result));
+                }
+            }
+
+            std::exception_ptr exception;
+        };
+
+        Task(Task&& other) noexcept
+        : coroutine(std::exchange(other.coroutine, {}))
+        {}
+
+        Task& operator=(Task&& other) noexcept
+        {
+            if(this != &other)
+            {
+                if(coroutine)
+                    coroutine.destroy();
+                coroutine = std::exchange(other.coroutine, {});
+            }
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task()
+        {
+            if(coroutine)
+                coroutine.destroy();
+        }
+
+        // Awaiting a task runs it on the current thread until its first suspension.
+        // Throws std::logic_error for an empty task, which was released or moved from
+        bool await_ready() const
+        {
+            if(!coroutine)
+                throw std::logic_error("empty coroutine task is awaited");
+            return coroutine.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
+        {
+            coroutine.promise().continuation = awaiting_coroutine;
+            return coroutine;
+        }
+
+        ResultType await_resume()
+        {
+            return coroutine.promise().GetResult();
+        }
+
+        // Gives up the ownership of the coroutine frame
+        std::coroutine_handle<promise_type> Release()
+        {
+            return std::exchange(coroutine, {});
+        }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> task_coroutine)
+        : coroutine(task_coroutine)
+        {}
+
+        std::coroutine_handle<promise_type> coroutine;
+    };
+
+    // Awaiter which suspends the coroutine and resumes it as a task on a worker of the manager
+    class ResumeOnWorker
+    {
+    public:
+        explicit ResumeOnWorker(TaskPriority resume_priority = TaskPriority::Normal, TaskManager& task_manager = TaskManager::GetInstance())
+        : priority(resume_priority), manager(task_manager)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> coroutine)
+        {
+            manager.RunTask(priority, [coroutine] { coroutine.resume(); });
+        }
+
+        void await_resume() const noexcept {}
+
+    private:
+        TaskPriority priority;
+        TaskManager& manager;
+    };
+
+    // Starts the coroutine on a worker. The returned handle is finished, when the coroutine is finished
+    template<class ResultType>
+    std::shared_ptr<TaskHandle<ResultType>> StartCoroutine(Task<ResultType> task, TaskPriority priority = TaskPriority::Normal,
+                                                           TaskManager& manager = TaskManager::GetInstance())
+    {
+        auto handle = std::allocate_shared<TaskHandle<ResultType>>(TaskPoolAllocator<TaskHandle<ResultType>>(), manager);
+
+        auto coroutine = task.Release();
+        coroutine.promise().detached_handle = handle;
+        manager.RunTask(priority, [coroutine] { coroutine.resume(); });
+        return handle;
+    }
+}
+
+// Awaiter for the handles of regular tasks. Suspended coroutine is resumed, when the task is finished, on a worker of the pool
+// it was awaiting on. So awaiting an I/O task doesn't move the rest of the coroutine to the I/O workers
+template<class ResultType>
+class TaskHandleAwaiter
+{
+public:
+    explicit TaskHandleAwaiter(std::shared_ptr<TaskHandle<ResultType>> task_handle)
+    : handle(std::move(task_handle))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return handle->HasTaskResult();
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine)
+    {
+        TaskManager& manager = TaskManager::GetCurrent();
+        handle->AddContinuation([&manager, coroutine] { manager.RunTask([coroutine] { coroutine.resume(); }); });
+    }
+
+    ResultType await_resume()
+    {
+        handle->ThrowIfFailed();
+        if constexpr (!std::is_void_v<ResultType>)
+            return handle->GetTaskResult();
+    }
+
+private:
+    std::shared_ptr<TaskHandle<ResultType>> handle;
+};
+
+template<class ResultType>
+TaskHandleAwaiter<ResultType> operator co_await(std::shared_ptr<TaskHandle<ResultType>> handle)
+{
+    return TaskHandleAwaiter<ResultType>(std::move(handle));
+}
\ No newline at end of file
@@ -0,0 +1,219 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "epoch_reclaimer.h"
+
+#include <memory>
+#include <vector>
+#include "locks/scoped_lock.h"
+#include "locks/spin_lock.h"
+
+namespace
+{
+    // Lowest bit of the thread epoch tells it's inside of a region, the epoch itself is shifted
+    constexpr uint64_t kActiveFlag = 1;
+
+    std::atomic_uint64_t global_epoch = 0;
+    std::atomic_size_t pending_count = 0;
+
+    struct RetiredObject
+    {
+        void* object;
+        EpochReclaimer::deleter_func deleter;
+        uint64_t epoch;
+    };
+
+    struct ThreadRecord
+    {
+        // Epoch seen when the current region was entered, or zero outside of the regions. Read by the threads advancing the epoch
+        alignas(64) std::atomic_uint64_t local_epoch = 0;
+        // Everything below is touched by the owner thread only
+        size_t nesting_count = 0;
+        std::vector<RetiredObject> retired_objects;
+        // Record of a finished thread is given to the next new thread with the objects it retired
+        std::atomic_bool is_owned = true;
+    };
+
+    struct RecordsRegistry
+    {
+        RecordsRegistry()
+        : lock("EpochReclaimerLock")
+        {}
+
+        SpinLock lock;
+        std::vector<std::unique_ptr<ThreadRecord>> records;
+    };
+
+    RecordsRegistry& GetRegistry()
+    {
+        // Never destroyed, since detached worker threads may enter the regions at the very end of the program
+        static auto* registry = new RecordsRegistry();
+        return *registry;
+    }
+
+    // Releases the record, when the thread is finished
+    struct ThreadRecordOwner
+    {
+        ~ThreadRecordOwner()
+        {
+            if(record)
+                record->is_owned.store(false, std::memory_order_release);
+        }
+
+        ThreadRecord* record = nullptr;
+    };
+
+    thread_local ThreadRecordOwner current_record;
+
+    ThreadRecord& GetThreadRecord()
+    {
+        if(current_record.record)
+            return *current_record.record;
+
+        auto& registry = GetRegistry();
+        ScopedLock scopeRegistryLock(registry.lock);
+        for(auto& record : registry.records)
+        {
+            bool is_owned = false;
+            if(!record->is_owned.load(std::memory_order_relaxed) && record->is_owned.compare_exchange_strong(is_owned, true, std::memory_order_acquire))
+            {
+                current_record.record = record.get();
+                return *record;
+            }
+        }
+
+        registry.records.emplace_back(new ThreadRecord());
+        current_record.record = registry.records.back().get();
+        return *current_record.record;
+    }
+
+    // Epoch moves forward only when every thread inside of a region has seen the current one
+    void TryAdvanceEpoch()
+    {
+        const uint64_t epoch = global_epoch.load(std::memory_order_relaxed);
+        // Pairs with the fence of EpochGuard, so either the region entry is seen here, or the region sees the unlinked object gone
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto& registry = GetRegistry();
+        {
+            ScopedLock scopeRegistryLock(registry.lock);
+            for(auto& record : registry.records)
+            {
+                const uint64_t local_epoch = record->local_epoch.load(std::memory_order_relaxed);
+                if((local_epoch & kActiveFlag) && (local_epoch >> 1) != epoch)
+                    return;
+            }
+        }
+
+        uint64_t expected_epoch = epoch;
+        global_epoch.compare_exchange_strong(expected_epoch, epoch + 1, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    // Objects retired two epochs ago can't be seen by anybody, the threads in the regions are at the current or previous one.
+    // They are moved to expired_objects, the deleters are run later, since they may retire objects themselves
+    void TakeExpiredObjects(ThreadRecord& record, std::vector<RetiredObject>& expired_objects)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t epoch = global_epoch.load(std::memory_order_acquire);
+
+        auto& retired_objects = record.retired_objects;
+        size_t kept_count = 0;
+        for(size_t i = 0; i < retired_objects.size(); ++i)
+        {
+            if(retired_objects[i].epoch + 2 <= epoch)
+                expired_objects.push_back(retired_objects[i]);
+            else
+                retired_objects[kept_count++] = retired_objects[i];
+        }
+        retired_objects.resize(kept_count);
+    }
+
+    // Objects retired by the finished threads would wait for a new thread taking their records otherwise
+    void TakeOrphanedObjects(std::vector<RetiredObject>& expired_objects)
+    {
+        auto& registry = GetRegistry();
+        ScopedLock scopeRegistryLock(registry.lock);
+        for(auto& record : registry.records)
+        {
+            bool is_owned = false;
+            if(record->is_owned.load(std::memory_order_relaxed) || !record->is_owned.compare_exchange_strong(is_owned, true, std::memory_order_acquire))
+                continue;
+
+            TakeExpiredObjects(*record, expired_objects);
+            record->is_owned.store(false, std::memory_order_release);
+        }
+    }
+
+    // Runs the deleters, no lock is held and no retired list is iterated at this point
+    void DeleteObjects(const std::vector<RetiredObject>& objects)
+    {
+        for(const auto& retired_object : objects)
+            retired_object.deleter(retired_object.object);
+        pending_count.fetch_sub(objects.size(), std::memory_order_relaxed);
+    }
+}
+
+EpochReclaimer::EpochGuard::EpochGuard()
+{
+    auto& record = GetThreadRecord();
+    if(record.nesting_count++ > 0)
+        return;
+
+    record.local_epoch.store((global_epoch.load(std::memory_order_relaxed) << 1) | kActiveFlag, std::memory_order_relaxed);
+    // Region entry has to be visible before any shared pointer is loaded
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+EpochReclaimer::EpochGuard::~EpochGuard()
+{
+    auto& record = GetThreadRecord();
+    if(--record.nesting_count > 0)
+        return;
+
+    record.local_epoch.store(0, std::memory_order_release);
+}
+
+void EpochReclaimer::Retire(void* object, deleter_func deleter)
+{
+    auto& record = GetThreadRecord();
+    // Object was unlinked before, so the readers entering the regions after this epoch can't find it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    record.retired_objects.push_back({ object, deleter, global_epoch.load(std::memory_order_relaxed) });
+    pending_count.fetch_add(1, std::memory_order_relaxed);
+
+    if(record.retired_objects.size() % kCollectThreshold == 0)
+        Collect();
+}
+
+void EpochReclaimer::Collect()
+{
+    if(pending_count.load(std::memory_order_relaxed) == 0)
+        return;
+
+    TryAdvanceEpoch();
+    std::vector<RetiredObject> expired_objects;
+    TakeExpiredObjects(GetThreadRecord(), expired_objects);
+    TakeOrphanedObjects(expired_objects);
+    DeleteObjects(expired_objects);
+}
+
+uint64_t EpochReclaimer::GetEpoch()
+{
+    return global_epoch.load(std::memory_order_relaxed);
+}
+
+size_t EpochReclaimer::GetPendingCount()
+{
+    return pending_count.load(std::memory_order_relaxed);
+}
\ No newline at end of file
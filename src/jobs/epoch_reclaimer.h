@@ -0,0 +1,60 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Epoch-based reclamation for the lock-free structures. Readers enter a critical region with EpochGuard before loading
+// shared pointers. A removed object is passed to Retire instead of being deleted, and is deleted once every thread
+// that could still see it has left its region. Regions should be short, a thread staying inside stops all the reclamation
+class EpochReclaimer
+{
+public:
+    // Retired objects of a thread, after which it tries to advance the epoch and free the old ones.
+    // Besides that, workers collect before falling asleep and the main thread in TaskManager::BeginFrame
+    static constexpr size_t kCollectThreshold = 64;
+
+    using deleter_func = void (*)(void*);
+
+    // Keeps the objects loaded inside of the region alive. Could be nested
+    class EpochGuard
+    {
+    public:
+        EpochGuard();
+        ~EpochGuard();
+
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+    };
+
+    // Deletes the object, when no thread can reference it anymore. It has to be unreachable for the new readers already
+    template<class ObjectClass>
+    static void Retire(ObjectClass* object)
+    {
+        Retire(object, [](void* retired_object) { delete static_cast<ObjectClass*>(retired_object); });
+    }
+
+    static void Retire(void* object, deleter_func deleter);
+
+    // Tries to advance the epoch and deletes the objects of the current and the finished threads, which are safe to delete
+    static void Collect();
+
+    static uint64_t GetEpoch();
+
+    // Objects retired, but not deleted yet by all threads
+    static size_t GetPendingCount();
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <memory>
+#include <vector>
+#include "locks/scoped_lock.h"
+#include "locks/spin_lock.h"
+#include "log.h"
+
+namespace
+{
+    std::atomic_uint64_t current_frame_index = 0;
+    std::atomic_size_t reserved_bytes_count = 0;
+    std::atomic_uint64_t pinned_slots_count = 0;
+
+    struct Chunk
+    {
+        std::unique_ptr<std::byte[]> memory;
+        size_t size;
+    };
+
+    // Memory of one frame slot. Only the owner thread allocates from it, other threads only decrement live_count
+    struct FrameMemory
+    {
+        std::vector<Chunk> chunks;
+        size_t current_chunk = 0;
+        size_t offset = 0;
+        std::atomic_size_t live_count = 0;
+
+        void Rewind()
+        {
+            current_chunk = 0;
+            offset = 0;
+        }
+
+        void* Allocate(size_t size, size_t alignment)
+        {
+            while(current_chunk < chunks.size())
+            {
+                auto& chunk = chunks[current_chunk];
+                const auto address = reinterpret_cast<uintptr_t>(chunk.memory.get()) + offset;
+                const size_t padding = (alignment - address % alignment) % alignment;
+                if(offset + padding + size <= chunk.size)
+                {
+                    offset += padding + size;
+                    return reinterpret_cast<void*>(address + padding);
+                }
+
+                ++current_chunk;
+                offset = 0;
+            }
+
+            // Chunks are kept after rewinding, so new ones are needed only while the frames grow
+            const size_t chunk_size = std::max(FrameArena::kChunkSize, size + alignment);
+            chunks.push_back({ std::unique_ptr<std::byte[]>(new std::byte[chunk_size]), chunk_size });
+            reserved_bytes_count.fetch_add(chunk_size, std::memory_order_relaxed);
+            current_chunk = chunks.size() - 1;
+            return Allocate(size, alignment);
+        }
+    };
+
+    struct ThreadArena
+    {
+        std::array<FrameMemory, FrameArena::kFramesCount> frames;
+        // Arena of a finished thread is given to the next new thread, since its allocations may be still alive
+        std::atomic_bool is_owned = true;
+    };
+
+    struct ArenasRegistry
+    {
+        ArenasRegistry()
+        : lock("FrameArenaLock")
+        {}
+
+        SpinLock lock;
+        std::vector<std::unique_ptr<ThreadArena>> arenas;
+    };
+
+    ArenasRegistry& GetRegistry()
+    {
+        // Never destroyed, since detached worker threads may release allocations at the very end of the program
+        static auto* registry = new ArenasRegistry();
+        return *registry;
+    }
+
+    // Releases the arena, when the thread is finished
+    struct ThreadArenaOwner
+    {
+        ~ThreadArenaOwner()
+        {
+            if(arena)
+                arena->is_owned.store(false, std::memory_order_release);
+        }
+
+        ThreadArena* arena = nullptr;
+    };
+
+    thread_local ThreadArenaOwner current_arena;
+
+    ThreadArena& GetThreadArena()
+    {
+        if(current_arena.arena)
+            return *current_arena.arena;
+
+        auto& registry = GetRegistry();
+        ScopedLock scopeRegistryLock(registry.lock);
+        for(auto& arena : registry.arenas)
+        {
+            bool is_owned = false;
+            if(!arena->is_owned.load(std::memory_order_relaxed) && arena->is_owned.compare_exchange_strong(is_owned, true, std::memory_order_acquire))
+            {
+                current_arena.arena = arena.get();
+                return *arena;
+            }
+        }
+
+        registry.arenas.emplace_back(new ThreadArena());
+        current_arena.arena = registry.arenas.back().get();
+        return *current_arena.arena;
+    }
+}
+
+void FrameArena::BeginFrame()
+{
+    const uint64_t frame_index = current_frame_index.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // Slots are rewound by their owner threads, here it's only checked that nothing of the old frame is left in them
+    size_t pinned_count = 0;
+    {
+        auto& registry = GetRegistry();
+        ScopedLock scopeRegistryLock(registry.lock);
+        for(auto& arena : registry.arenas)
+        {
+            if(arena->frames[frame_index % kFramesCount].live_count.load(std::memory_order_relaxed) != 0)
+                ++pinned_count;
+        }
+    }
+
+    if(pinned_count == 0)
+        return;
+
+    pinned_slots_count.fetch_add(pinned_count, std::memory_order_relaxed);
+    log_warn("Frame arena slots of %zu threads are still used by the tasks of frame %llu, they grow until the tasks are destroyed",
+             pinned_count, static_cast<unsigned long long>(frame_index - kFramesCount));
+}
+
+uint64_t FrameArena::GetFrameIndex()
+{
+    return current_frame_index.load(std::memory_order_relaxed);
+}
+
+FrameArena::Allocation FrameArena::Allocate(uint64_t frame_index, size_t size, size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    auto& frame_memory = GetThreadArena().frames[frame_index % kFramesCount];
+    // Acquire pairs with the release of the last destroyed object, so its memory isn't touched anymore
+    if(frame_memory.live_count.load(std::memory_order_acquire) == 0)
+        frame_memory.Rewind();
+
+    void* memory = frame_memory.Allocate(size, alignment);
+    frame_memory.live_count.fetch_add(1, std::memory_order_relaxed);
+    return { memory, &frame_memory.live_count };
+}
+
+size_t FrameArena::GetReservedBytesCount()
+{
+    return reserved_bytes_count.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameArena::GetPinnedSlotsCount()
+{
+    return pinned_slots_count.load(std::memory_order_relaxed);
+}
\ No newline at end of file
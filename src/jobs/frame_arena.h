@@ -0,0 +1,51 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Linear allocator for the transient tasks of a frame. Every thread bump-allocates from its own chunks, separately for each
+// of the last kFramesCount frames. Memory of a frame slot is rewound, when everything allocated from it was released,
+// so a task lingering from the previous frame doesn't hold the memory of the current one. A task outliving kFramesCount
+// frames pins its slot: the slot can't be rewound and grows with every frame mapped to it, until the task is destroyed
+class FrameArena
+{
+public:
+    static constexpr size_t kFramesCount = 3;
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    struct Allocation
+    {
+        void* memory;
+        // Should be decremented, when the allocated object is destroyed. Memory isn't reused until it's zero
+        std::atomic_size_t* live_count;
+    };
+
+    // Advances the frame index. Should be called exactly once per frame by the main loop, whatever count of pools it has
+    static void BeginFrame();
+
+    static uint64_t GetFrameIndex();
+
+    // Allocates from the arena of the current thread for the frame
+    static Allocation Allocate(uint64_t frame_index, size_t size, size_t alignment);
+
+    // Bytes held by the arenas of all threads. Stays the same in the steady state
+    static size_t GetReservedBytesCount();
+
+    // Count of thread slots, which were still used by the tasks of an old frame, when BeginFrame reused them. Should stay zero
+    static uint64_t GetPinnedSlotsCount();
+};
\ No newline at end of file
@@ -0,0 +1,88 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <type_traits>
+#include "task_handle_base.h"
+
+// Shared state of a TaskManager::ParallelFor call. Every participant claims chunks of the range until it's exhausted.
+// Chunks start big and shrink as the range is consumed, so a slow participant can't hold much of the remaining work
+template<class IndexType, class Function>
+class ParallelForState : public TaskHandleBase
+{
+    static_assert(std::is_integral_v<IndexType>, "ParallelFor works with integral indices only");
+
+public:
+    ParallelForState(IndexType range_begin, IndexType range_end, IndexType min_chunk_size, unsigned participants_count, Function& func)
+    : next_index(range_begin), end(range_end), grain(std::max<IndexType>(min_chunk_size, 1)),
+      participants(std::max(participants_count, 1u)), pending_count(range_end - range_begin), function(func)
+    {}
+
+    // Claims and processes one chunk of the range. Returns false, if there is nothing left to claim
+    bool ProcessChunk()
+    {
+        IndexType chunk_begin = next_index.load(std::memory_order_relaxed);
+        IndexType chunk_end;
+        do
+        {
+            if(chunk_begin >= end)
+                return false;
+
+            const IndexType remaining = end - chunk_begin;
+            const IndexType chunk_size = std::max<IndexType>(grain, remaining / (2 * participants));
+            chunk_end = chunk_begin + std::min(chunk_size, remaining);
+        }
+        while(!next_index.compare_exchange_weak(chunk_begin, chunk_end, std::memory_order_relaxed));
+
+        // After a failure the chunks are only claimed, so the participants finish quickly
+        if(!has_failed.load(std::memory_order_relaxed))
+        {
+            try
+            {
+                for(IndexType i = chunk_begin; i < chunk_end; ++i)
+                    function(i);
+            }
+            catch(...)
+            {
+                // Only the first exception is kept, it's published by the pending count like the processed items
+                if(!has_failed.exchange(true, std::memory_order_relaxed))
+                    exception = std::current_exception();
+            }
+        }
+
+        pending_count.fetch_sub(chunk_end - chunk_begin, std::memory_order_release);
+        return true;
+    }
+
+    // All items of the range are processed
+    bool HasTaskResult() const override
+    {
+        return pending_count.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    std::atomic<IndexType> next_index;
+    const IndexType end;
+    const IndexType grain;
+    const IndexType participants;
+    std::atomic<IndexType> pending_count;
+    std::atomic_bool has_failed = false;
+
+    // Called only for claimed chunks, so helpers that start after the whole range is processed never touch it
+    Function& function;
+};
\ No newline at end of file
@@ -0,0 +1,262 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace ring_buffer_details
+{
+    static constexpr size_t kCacheLineSize = 64;
+
+    // Capacity has to be a power of two to use a mask instead of a modulo
+    inline size_t RoundUpCapacity(size_t capacity)
+    {
+        size_t result = 1;
+        while(result < capacity)
+            result <<= 1;
+        return result;
+    }
+
+    // Storage for an item, which is constructed only while the slot is filled
+    template<class ItemType>
+    struct ItemStorage
+    {
+        template<class ValueType>
+        void Construct(ValueType&& value)
+        {
+            new(memory) ItemType(std::forward<ValueType>(value));
+        }
+
+        // Moves the item out and destroys it
+        ItemType Extract()
+        {
+            auto* item = std::launder(reinterpret_cast<ItemType*>(memory));
+            ItemType result(std::move(*item));
+            item->~ItemType();
+            return result;
+        }
+
+        void Destroy()
+        {
+            std::launder(reinterpret_cast<ItemType*>(memory))->~ItemType();
+        }
+
+        alignas(ItemType) std::byte memory[sizeof(ItemType)];
+    };
+}
+
+// Bounded lock-free queue for one producer and one consumer thread. Each side keeps a copy of the other's index,
+// so the shared line is read only when the copy says the queue is full or empty
+template<class ItemType>
+class SpscRingBuffer
+{
+public:
+    explicit SpscRingBuffer(size_t capacity);
+    ~SpscRingBuffer();
+
+    SpscRingBuffer(const SpscRingBuffer<ItemType>&) = delete;
+    SpscRingBuffer<ItemType>& operator=(const SpscRingBuffer<ItemType>&) = delete;
+
+    // Returns false, if the queue is full. Producer thread only
+    template<class ValueType>
+    bool TryPush(ValueType&& value);
+
+    // Returns nothing, if the queue is empty. Consumer thread only
+    std::optional<ItemType> TryPop();
+
+    bool IsEmpty() const;
+
+    size_t GetCapacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    using ItemStorage = ring_buffer_details::ItemStorage<ItemType>;
+
+    const size_t mask;
+    std::unique_ptr<ItemStorage[]> slots;
+
+    // Index of the next item to pop, and the last seen push index. Written by the consumer
+    alignas(ring_buffer_details::kCacheLineSize) std::atomic_size_t head = 0;
+    size_t cached_tail = 0;
+    // Index of the next item to push, and the last seen pop index. Written by the producer
+    alignas(ring_buffer_details::kCacheLineSize) std::atomic_size_t tail = 0;
+    size_t cached_head = 0;
+};
+
+template<class ItemType>
+SpscRingBuffer<ItemType>::SpscRingBuffer(size_t capacity)
+: mask(ring_buffer_details::RoundUpCapacity(capacity) - 1), slots(new ItemStorage[mask + 1])
+{}
+
+template<class ItemType>
+SpscRingBuffer<ItemType>::~SpscRingBuffer()
+{
+    const size_t current_tail = tail.load(std::memory_order_relaxed);
+    for(size_t index = head.load(std::memory_order_relaxed); index != current_tail; ++index)
+        slots[index & mask].Destroy();
+}
+
+template<class ItemType>
+template<class ValueType>
+bool SpscRingBuffer<ItemType>::TryPush(ValueType&& value)
+{
+    const size_t current_tail = tail.load(std::memory_order_relaxed);
+    if(current_tail - cached_head > mask)
+    {
+        cached_head = head.load(std::memory_order_acquire);
+        if(current_tail - cached_head > mask)
+            return false;
+    }
+
+    slots[current_tail & mask].Construct(std::forward<ValueType>(value));
+    tail.store(current_tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<class ItemType>
+std::optional<ItemType> SpscRingBuffer<ItemType>::TryPop()
+{
+    const size_t current_head = head.load(std::memory_order_relaxed);
+    if(current_head == cached_tail)
+    {
+        cached_tail = tail.load(std::memory_order_acquire);
+        if(current_head == cached_tail)
+            return std::nullopt;
+    }
+
+    std::optional<ItemType> result(slots[current_head & mask].Extract());
+    head.store(current_head + 1, std::memory_order_release);
+    return result;
+}
+
+template<class ItemType>
+bool SpscRingBuffer<ItemType>::IsEmpty() const
+{
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+// Bounded lock-free queue for many producers and one consumer (see "Bounded MPMC queue", D. Vyukov).
+// Every slot has a sequence number telling whether it's free for the push or filled for the pop of the current lap,
+// so producers only race for the tail index and never wait for each other
+template<class ItemType>
+class MpscRingBuffer
+{
+public:
+    explicit MpscRingBuffer(size_t capacity);
+    ~MpscRingBuffer();
+
+    MpscRingBuffer(const MpscRingBuffer<ItemType>&) = delete;
+    MpscRingBuffer<ItemType>& operator=(const MpscRingBuffer<ItemType>&) = delete;
+
+    // Returns false, if the queue is full. Any thread
+    template<class ValueType>
+    bool TryPush(ValueType&& value);
+
+    // Returns nothing, if the queue is empty or the next item is still being pushed. Consumer thread only
+    std::optional<ItemType> TryPop();
+
+    bool IsEmpty() const;
+
+    size_t GetCapacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic_size_t sequence;
+        ring_buffer_details::ItemStorage<ItemType> storage;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    alignas(ring_buffer_details::kCacheLineSize) std::atomic_size_t head = 0;
+    alignas(ring_buffer_details::kCacheLineSize) std::atomic_size_t tail = 0;
+};
+
+template<class ItemType>
+MpscRingBuffer<ItemType>::MpscRingBuffer(size_t capacity)
+: mask(ring_buffer_details::RoundUpCapacity(capacity) - 1), slots(new Slot[mask + 1])
+{
+    for(size_t index = 0; index <= mask; ++index)
+        slots[index].sequence.store(index, std::memory_order_relaxed);
+}
+
+template<class ItemType>
+MpscRingBuffer<ItemType>::~MpscRingBuffer()
+{
+    while(TryPop().has_value()) {}
+}
+
+template<class ItemType>
+template<class ValueType>
+bool MpscRingBuffer<ItemType>::TryPush(ValueType&& value)
+{
+    size_t current_tail = tail.load(std::memory_order_relaxed);
+    while(true)
+    {
+        Slot& slot = slots[current_tail & mask];
+        const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(current_tail);
+        if(difference == 0)
+        {
+            if(tail.compare_exchange_weak(current_tail, current_tail + 1, std::memory_order_relaxed))
+            {
+                slot.storage.Construct(std::forward<ValueType>(value));
+                slot.sequence.store(current_tail + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if(difference < 0)
+        {
+            // Slot still holds the item of the previous lap
+            return false;
+        }
+        else
+            current_tail = tail.load(std::memory_order_relaxed);
+    }
+}
+
+template<class ItemType>
+std::optional<ItemType> MpscRingBuffer<ItemType>::TryPop()
+{
+    const size_t current_head = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[current_head & mask];
+    if(slot.sequence.load(std::memory_order_acquire) != current_head + 1)
+        return std::nullopt;
+
+    std::optional<ItemType> result(slot.storage.Extract());
+    head.store(current_head + 1, std::memory_order_relaxed);
+    // Frees the slot for the push of the next lap
+    slot.sequence.store(current_head + mask + 1, std::memory_order_release);
+    return result;
+}
+
+template<class ItemType>
+bool MpscRingBuffer<ItemType>::IsEmpty() const
+{
+    const size_t current_head = head.load(std::memory_order_relaxed);
+    return slots[current_head & mask].sequence.load(std::memory_order_acquire) != current_head + 1;
+}
\ No newline at end of file
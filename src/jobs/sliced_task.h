@@ -0,0 +1,114 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include "task_base.h"
+#include "task_handle.h"
+
+class TaskManager;
+
+// Handle of a sliced task. Finished, when the task body returns true
+class SlicedTaskHandle : public TaskHandle<void>
+{
+public:
+    explicit SlicedTaskHandle(TaskManager& owner_manager)
+            : TaskHandle<void>(owner_manager) {}
+
+    // Part of the work done in [0, 1], as reported by the task body
+    float GetProgress() const
+    {
+        return progress.load(std::memory_order_relaxed);
+    }
+
+    void SetProgress(float value)
+    {
+        progress.store(std::clamp(value, 0.f, 1.f), std::memory_order_relaxed);
+    }
+
+    // Count of the slices run so far
+    unsigned GetSlicesCount() const
+    {
+        return slices_count.load(std::memory_order_relaxed);
+    }
+
+    void AddSlice()
+    {
+        slices_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<float> progress = 0.f;
+    std::atomic_uint slices_count = 0;
+};
+
+// Time budget of one call of a sliced task body
+class TaskSlice
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TaskSlice(Clock::time_point slice_end_time, SlicedTaskHandle* task_handle)
+            : end_time(slice_end_time), handle(task_handle) {}
+
+    // Body should save its state and return soon after the slice is expired
+    bool IsExpired() const
+    {
+        return Clock::now() >= end_time;
+    }
+
+    Clock::time_point GetEndTime() const
+    {
+        return end_time;
+    }
+
+    // Publishes the progress to the handle, if somebody still holds it
+    void SetProgress(float value)
+    {
+        if(handle)
+            handle->SetProgress(value);
+    }
+
+private:
+    Clock::time_point end_time;
+    SlicedTaskHandle* handle;
+};
+
+// Task which body is called with a time budget again and again, until it returns true.
+// Between the calls the task goes back to the queue, so it doesn't hold a worker or the main thread for longer than a slice.
+// RunTask is defined in task_manager.h
+template<class Function>
+class SlicedTask : public TaskBase
+{
+public:
+    SlicedTask(TaskManager& owner_manager, Function func, std::weak_ptr<SlicedTaskHandle> handle,
+               std::chrono::nanoseconds budget, bool is_main_thread_task)
+            : manager(owner_manager), function_to_run(std::move(func)), task_handle(std::move(handle)),
+              slice_budget(budget), is_main_thread(is_main_thread_task)
+    {}
+
+    void RunTask() override;
+
+protected:
+    TaskManager& manager;
+    Function function_to_run;
+    std::weak_ptr<SlicedTaskHandle> task_handle;
+    std::chrono::nanoseconds slice_budget;
+    bool is_main_thread;
+};
\ No newline at end of file
@@ -14,68 +14,110 @@
 
 #pragma once
 
+#include <exception>
 #include <functional>
 #include <memory>
 #include <thread>
 #include <utility>
 #include "task_base.h"
 #include "task_handle.h"
+#include "task_profiler.h"
 #include "log.h"
 
 
-template<class ResultType>
+// Passes the exception of a failed task to its handle, so the worker survives and the waiter rethrows it.
+// If nobody holds the handle, there is nobody to rethrow it to, and it's only logged
+template<class HandleType>
+void FailTask(const std::weak_ptr<HandleType>& task_handle, std::exception_ptr exception)
+{
+    auto shared_handle = task_handle.lock();
+    // A continuation of the finished handle could throw too
+    if (shared_handle && !shared_handle->HasTaskResult())
+    {
+        shared_handle->SetTaskException(std::move(exception));
+        return;
+    }
+
+    try
+    {
+        std::rethrow_exception(exception);
+    }
+    catch (const std::exception& e)
+    {
+        log_err("Unhandled exception in a task: %s", e.what());
+    }
+    catch (...)
+    {
+        log_err("Unhandled exception in a task");
+    }
+}
+
+// Function is stored in the task itself, so it doesn't need a separate allocation like std::function would do
+template<class ResultType, class Function = std::function<ResultType()>>
 class Task : public TaskBase
 {
 public:
 
-    Task(const std::function<ResultType()>& func, const std::weak_ptr<TaskHandle<ResultType>>& handle)
-            : function_to_run(func), task_handle(handle)
+    Task(Function func, const std::weak_ptr<TaskHandle<ResultType>>& handle)
+            : function_to_run(std::move(func)), task_handle(handle)
     {}
 
     void RunTask() override
     {
         log_dbg("Running task %p", (void *) this);
+        TaskProfiler::ScopedTaskRun profile_scope(*this);
 
-        ResultType result = function_to_run();
-        if (!task_handle.expired())
+        try
         {
-            auto shared_handle = task_handle.lock();
-            shared_handle->SetTaskResult(std::move(result));
+            ResultType result = function_to_run();
+            // The handle may expire between a check and lock, so only the result of lock is reliable
+            if (auto shared_handle = task_handle.lock())
+                shared_handle->SetTaskResult(std::move(result));
+        }
+        catch (...)
+        {
+            FailTask(task_handle, std::current_exception());
         }
 
         log_dbg("Finished task %p", (void *) this);
     }
 
 protected:
-    std::function<ResultType()> function_to_run;
+    Function function_to_run;
     std::weak_ptr<TaskHandle<ResultType>> task_handle;
 };
 
 // void specialization of the Task class
-template<>
-class Task<void> : public TaskBase
+template<class Function>
+class Task<void, Function> : public TaskBase
 {
 public:
 
-    Task(std::function<void()> func, std::weak_ptr<TaskHandle<void>> handle)
+    Task(Function func, std::weak_ptr<TaskHandle<void>> handle)
             : function_to_run(std::move(func)), task_handle(std::move(handle))
     {}
 
     void RunTask() override
     {
         log_dbg("Running task %p", (void *) this);
+        TaskProfiler::ScopedTaskRun profile_scope(*this);
 
-        function_to_run();
-        if (!task_handle.expired())
+        try
+        {
+            function_to_run();
+            // The handle may expire between a check and lock, so only the result of lock is reliable
+            if (auto shared_handle = task_handle.lock())
+                shared_handle->MarkFinished();
+        }
+        catch (...)
         {
-            auto shared_handle = task_handle.lock();
-            shared_handle->MarkFinished();
+            FailTask(task_handle, std::current_exception());
         }
 
         log_dbg("Finished task %p", (void *) this);
     }
 
 protected:
-    std::function<void()> function_to_run;
+    Function function_to_run;
     std::weak_ptr<TaskHandle<void>> task_handle;
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_allocator.h"
+
+#include <array>
+#include <atomic>
+#include "locks/scoped_lock.h"
+#include "locks/spin_lock.h"
+
+namespace
+{
+    constexpr std::array<size_t, 4> kBlockSizes = { 64, 128, 256, TaskAllocator::kMaxBlockSize };
+
+    // Count of blocks moved between a thread cache and the shared pool at once
+    constexpr size_t kBatchSize = 32;
+    // Thread cache gives a batch back to the shared pool, when it has more blocks than that
+    constexpr size_t kMaxCachedBlocks = 4 * kBatchSize;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct BlockList
+    {
+        FreeBlock* head = nullptr;
+        size_t count = 0;
+
+        void Push(FreeBlock* block)
+        {
+            block->next = head;
+            head = block;
+            ++count;
+        }
+
+        FreeBlock* Pop()
+        {
+            FreeBlock* block = head;
+            head = block->next;
+            --count;
+            return block;
+        }
+
+        // Moves up to max_count blocks to the other list
+        void MoveTo(BlockList& other, size_t max_count)
+        {
+            while(head && max_count-- > 0)
+                other.Push(Pop());
+        }
+    };
+
+    struct SharedPool
+    {
+        SharedPool()
+        : lock("TaskAllocatorLock")
+        {}
+
+        SpinLock lock;
+        std::array<BlockList, kBlockSizes.size()> free_blocks;
+    };
+
+    // Touched only on the heap path, so it doesn't make the pooled allocations contend
+    std::atomic_uint64_t heap_allocations_count = 0;
+
+    SharedPool& GetSharedPool()
+    {
+        // Never destroyed, since detached worker threads may free blocks at the very end of the program
+        static auto* pool = new SharedPool();
+        return *pool;
+    }
+
+    // Set, when the cache of the thread is destroyed. Trivially destructible, so it can still be read after that
+    thread_local bool is_thread_cache_destroyed = false;
+
+    struct ThreadCache
+    {
+        std::array<BlockList, kBlockSizes.size()> free_blocks;
+
+        ~ThreadCache()
+        {
+            auto& pool = GetSharedPool();
+            ScopedLock scopePoolLock(pool.lock);
+            for(size_t i = 0; i < free_blocks.size(); ++i)
+                free_blocks[i].MoveTo(pool.free_blocks[i], free_blocks[i].count);
+            is_thread_cache_destroyed = true;
+        }
+    };
+
+    // Main thread destroys it before the static objects, which may still free tasks, like the TaskManager does
+    thread_local ThreadCache thread_cache;
+
+    size_t GetSizeClass(size_t size)
+    {
+        size_t size_class = 0;
+        while(kBlockSizes[size_class] < size)
+            ++size_class;
+        return size_class;
+    }
+}
+
+void* TaskAllocator::Allocate(size_t size)
+{
+    if(size > kMaxBlockSize)
+    {
+        heap_allocations_count.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    const size_t size_class = GetSizeClass(size);
+    if(is_thread_cache_destroyed)
+    {
+        auto& pool = GetSharedPool();
+        ScopedLock scopePoolLock(pool.lock);
+        if(pool.free_blocks[size_class].head)
+            return pool.free_blocks[size_class].Pop();
+    }
+    else
+    {
+        auto& cached_blocks = thread_cache.free_blocks[size_class];
+        if(!cached_blocks.head)
+        {
+            auto& pool = GetSharedPool();
+            ScopedLock scopePoolLock(pool.lock);
+            pool.free_blocks[size_class].MoveTo(cached_blocks, kBatchSize);
+        }
+
+        if(cached_blocks.head)
+            return cached_blocks.Pop();
+    }
+
+    heap_allocations_count.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(kBlockSizes[size_class]);
+}
+
+void TaskAllocator::Deallocate(void* ptr, size_t size)
+{
+    if(!ptr)
+        return;
+
+    if(size > kMaxBlockSize)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    const size_t size_class = GetSizeClass(size);
+    if(is_thread_cache_destroyed)
+    {
+        auto& pool = GetSharedPool();
+        ScopedLock scopePoolLock(pool.lock);
+        pool.free_blocks[size_class].Push(static_cast<FreeBlock*>(ptr));
+        return;
+    }
+
+    auto& cached_blocks = thread_cache.free_blocks[size_class];
+    cached_blocks.Push(static_cast<FreeBlock*>(ptr));
+
+    if(cached_blocks.count > kMaxCachedBlocks)
+    {
+        auto& pool = GetSharedPool();
+        ScopedLock scopePoolLock(pool.lock);
+        cached_blocks.MoveTo(pool.free_blocks[size_class], kBatchSize);
+    }
+}
+
+uint64_t TaskAllocator::GetHeapAllocationsCount()
+{
+    return heap_allocations_count.load(std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Pool of fixed size memory blocks for tasks and task handles.
+// Each thread keeps a cache of free blocks, so blocks freed by workers are reused without locking in most cases.
+// Blocks are exchanged with the shared pool in batches and are never returned to the system.
+class TaskAllocator
+{
+public:
+    // Blocks bigger than that are allocated directly on the heap
+    static constexpr size_t kMaxBlockSize = 512;
+    static constexpr size_t kBlockAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    static void* Allocate(size_t size);
+    static void Deallocate(void* ptr, size_t size);
+
+    // Count of blocks requested from the heap. Stays the same in the steady state
+    static uint64_t GetHeapAllocationsCount();
+};
+
+// Standard allocator over TaskAllocator, used to allocate shared task handles
+template<class ValueType>
+class TaskPoolAllocator
+{
+public:
+    using value_type = ValueType;
+
+    TaskPoolAllocator() noexcept = default;
+
+    template<class OtherType>
+    TaskPoolAllocator(const TaskPoolAllocator<OtherType>&) noexcept {}
+
+    ValueType* allocate(size_t count)
+    {
+        if constexpr (alignof(ValueType) > TaskAllocator::kBlockAlignment)
+            return static_cast<ValueType*>(::operator new(count * sizeof(ValueType), std::align_val_t(alignof(ValueType))));
+        else
+            return static_cast<ValueType*>(TaskAllocator::Allocate(count * sizeof(ValueType)));
+    }
+
+    void deallocate(ValueType* ptr, size_t count) noexcept
+    {
+        if constexpr (alignof(ValueType) > TaskAllocator::kBlockAlignment)
+            ::operator delete(ptr, count * sizeof(ValueType), std::align_val_t(alignof(ValueType)));
+        else
+            TaskAllocator::Deallocate(ptr, count * sizeof(ValueType));
+    }
+
+    template<class OtherType>
+    bool operator==(const TaskPoolAllocator<OtherType>&) const noexcept { return true; }
+
+    template<class OtherType>
+    bool operator!=(const TaskPoolAllocator<OtherType>&) const noexcept { return false; }
+};
\ No newline at end of file
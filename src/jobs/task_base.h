@@ -16,6 +16,10 @@
 
 #include <array>
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include "task_allocator.h"
 
 enum class TaskPriority
 {
@@ -55,9 +59,52 @@ constexpr static const char* GetPriorityName(TaskPriority priority)
     }
 }
 
+// Index of the priority in AllTaskPriorities
+constexpr static size_t GetPriorityIndex(TaskPriority priority)
+{
+    return static_cast<size_t>(priority);
+}
+
+// Background tasks are limited by the per-frame budget of the TaskManager
+constexpr static bool IsBackgroundPriority(TaskPriority priority)
+{
+    return priority == TaskPriority::Low || priority == TaskPriority::VeryLow;
+}
+
 // Abstract templateless task class
 class TaskBase
 {
 public:
+    virtual ~TaskBase() = default;
+
     virtual void RunTask() = 0;
+
+    // Tasks are allocated from the pool, so submitting a task doesn't touch the heap in the steady state
+    static void* operator new(size_t size)
+    {
+        return TaskAllocator::Allocate(size);
+    }
+
+    static void operator delete(void* ptr, size_t size)
+    {
+        TaskAllocator::Deallocate(ptr, size);
+    }
+
+    // Over-aligned tasks can't be stored in the pool blocks
+    static void* operator new(size_t size, std::align_val_t alignment)
+    {
+        return ::operator new(size, alignment);
+    }
+
+    static void operator delete(void* ptr, size_t size, std::align_val_t alignment)
+    {
+        ::operator delete(ptr, size, alignment);
+    }
+
+    // Set by TaskManager::AddTask. Enqueue time is set only while the TaskProfiler is enabled
+    std::chrono::steady_clock::time_point enqueue_time;
+    TaskPriority priority = TaskPriority::Normal;
+
+    // Tasks with a deadline are run before the other tasks of the same priority, in the order of their deadlines
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_group.h"
+
+TaskGroup::TaskGroup(TaskManager& owner_manager, TaskPriority group_priority)
+    : manager(owner_manager), priority(group_priority), frame_index(FrameArena::GetFrameIndex()), handle(owner_manager.MakeHandle<void>())
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    // Tasks refer to the group, so it can't go away before them. Exceptions are only rethrown by Wait
+    Close();
+    if (!handle->HasTaskResult())
+        manager.WaitForTask(*handle);
+}
+
+std::shared_ptr<TaskHandle<void>> TaskGroup::Close()
+{
+    if (!is_closed)
+    {
+        is_closed = true;
+        OnTaskDestroyed();
+    }
+    return handle;
+}
+
+void TaskGroup::Wait()
+{
+    Close()->WaitForTaskResult();
+}
+
+void TaskGroup::OnTaskDestroyed()
+{
+    if (pending_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // The waiter may destroy the group as soon as the handle is finished
+    auto finished_handle = handle;
+    if (has_failed.load(std::memory_order_relaxed))
+        finished_handle->SetTaskException(exception);
+    else
+        finished_handle->MarkFinished();
+}
+
+void TaskGroup::Fail(std::exception_ptr task_exception)
+{
+    if (!has_failed.exchange(true, std::memory_order_relaxed))
+        exception = std::move(task_exception);
+}
\ No newline at end of file
@@ -0,0 +1,172 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "frame_arena.h"
+#include "task_manager.h"
+
+// Transient tasks of one frame, which are waited for together. Tasks and their captured data are bump-allocated from the
+// FrameArena of the submitting thread, so they cost neither a pool allocation nor a free. The destructor waits for the group
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskManager& owner_manager = TaskManager::GetInstance(), TaskPriority group_priority = TaskPriority::Normal);
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Puts func() to the execution queue as a part of the group. The group must not be closed yet
+    template<class Function>
+    void Run(Function&& func);
+
+    // No more tasks could be added after that. Returns a handle, which is finished, when all tasks of the group are finished.
+    // If some of them failed, the handle fails with the first exception
+    std::shared_ptr<TaskHandle<void>> Close();
+
+    // Closes the group and waits for all its tasks. Rethrows the first exception of them
+    void Wait();
+
+    // Closes the group and runs func() as a new task, when all tasks of the group are finished
+    template<class Function>
+    auto Then(Function&& func)
+    {
+        return Close()->Then(priority, std::forward<Function>(func));
+    }
+
+    uint64_t GetFrameIndex() const
+    {
+        return frame_index;
+    }
+
+private:
+    // Stored in the arena right before the task. It's not a part of the task, so it's still valid in the operator delete,
+    // which runs after the task is completely destroyed
+    struct TaskRelease
+    {
+        TaskGroup* group;
+        std::atomic_size_t* live_count;
+
+        // Notifies the group. The arena may reuse the task memory right after the release, so nothing of it is read after that
+        void Release() const
+        {
+            TaskGroup* owner_group = group;
+            live_count->fetch_sub(1, std::memory_order_release);
+            owner_group->OnTaskDestroyed();
+        }
+    };
+
+    template<class Function>
+    class FrameTask final : public TaskBase
+    {
+    public:
+        // Offset of the task from the start of the allocation, the TaskRelease goes first
+        static constexpr size_t GetTaskOffset()
+        {
+            return (sizeof(TaskRelease) + alignof(FrameTask) - 1) / alignof(FrameTask) * alignof(FrameTask);
+        }
+
+        static constexpr size_t GetAllocationAlignment()
+        {
+            return std::max(alignof(FrameTask), alignof(TaskRelease));
+        }
+
+        template<class FunctionArg>
+        FrameTask(TaskGroup& owner_group, FunctionArg&& func)
+        : group(owner_group), function_to_run(std::forward<FunctionArg>(func))
+        {}
+
+        void RunTask() override
+        {
+            TaskProfiler::ScopedTaskRun profile_scope(*this);
+            try
+            {
+                function_to_run();
+            }
+            catch (...)
+            {
+                group.Fail(std::current_exception());
+            }
+        }
+
+        // Constructed in the arena memory, after the TaskRelease
+        static void* operator new(size_t, void* memory) noexcept
+        {
+            return memory;
+        }
+
+        // Called, if the constructor throws
+        static void operator delete(void* memory, void*) noexcept
+        {
+            GetRelease(memory).Release();
+        }
+
+        // Called after the task is destroyed. Memory goes back to the arena, when the frame slot is rewound
+        static void operator delete(void* memory, size_t) noexcept
+        {
+            GetRelease(memory).Release();
+        }
+
+    private:
+        static TaskRelease& GetRelease(void* memory)
+        {
+            return *std::launder(reinterpret_cast<TaskRelease*>(static_cast<std::byte*>(memory) - GetTaskOffset()));
+        }
+
+        TaskGroup& group;
+        Function function_to_run;
+    };
+
+    void OnTaskDestroyed();
+
+    // Keeps the first exception
+    void Fail(std::exception_ptr task_exception);
+
+    TaskManager& manager;
+    const TaskPriority priority;
+    const uint64_t frame_index;
+    std::shared_ptr<TaskHandle<void>> handle;
+
+    // Tasks which aren't destroyed yet, plus one until the group is closed
+    std::atomic_size_t pending_count = 1;
+    bool is_closed = false;
+
+    std::atomic_bool has_failed = false;
+    std::exception_ptr exception;
+};
+
+template<class Function>
+void TaskGroup::Run(Function&& func)
+{
+    using TaskType = FrameTask<std::decay_t<Function>>;
+    assert(!is_closed);
+
+    auto allocation = FrameArena::Allocate(frame_index, TaskType::GetTaskOffset() + sizeof(TaskType), TaskType::GetAllocationAlignment());
+    new (allocation.memory) TaskRelease{ this, allocation.live_count };
+    // Counted before the task is constructed, since a failed construction releases it too
+    pending_count.fetch_add(1, std::memory_order_relaxed);
+    void* task_memory = static_cast<std::byte*>(allocation.memory) + TaskType::GetTaskOffset();
+    std::unique_ptr<TaskBase> task(new (task_memory) TaskType(*this, std::forward<Function>(func)));
+    manager.AddTask(std::move(task), priority);
+}
\ No newline at end of file
@@ -16,49 +16,91 @@
 
 #include <atomic>
 #include <cassert>
-#include <functional>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <type_traits>
 #include <utility>
+#include "task_base.h"
 #include "task_handle_base.h"
 
+class TaskManager;
+
+// Methods which need the TaskManager are defined in task_manager.h
 template<class ResultType>
 class TaskHandle : public TaskHandleBase
 {
 public:
-    TaskHandle(const std::function<void(const TaskHandleBase &)> &handle_wait_function)
-            : wait_function(handle_wait_function) {}
+    explicit TaskHandle(TaskManager& owner_manager)
+            : manager(owner_manager) {}
 
     TaskHandle(const TaskHandle<ResultType> &) = delete;
     TaskHandle(TaskHandle<ResultType> &&) = delete;
 
-    // Sets result of the task for this handle. Typically called by the connected task
+    // Sets result of the task for this handle and runs continuations. Typically called by the connected task
     void SetTaskResult(ResultType &&result)
     {
         assert(!has_result.load(std::memory_order_relaxed));
 
         task_result = std::move(result);
         has_result.store(true, std::memory_order_release);
+        RunContinuations();
     }
 
-    // Returns the task result, when the task is finished. Until that moment blocks current thread
-    ResultType WaitForTaskResult()
+    // Finishes the handle with the exception thrown by the connected task. Waiting for the result rethrows it
+    void SetTaskException(std::exception_ptr task_exception)
     {
-        while (!has_result.load(std::memory_order_acquire))
-            wait_function(*this);
+        assert(!has_result.load(std::memory_order_relaxed));
+
+        exception = std::move(task_exception);
+        has_result.store(true, std::memory_order_release);
+        RunContinuations();
+    }
+
+    // Returns the task result, when the task is finished. Until that moment blocks current thread.
+    // Rethrows the exception, if the task failed
+    ResultType WaitForTaskResult();
+
+    // Returns the task result, or nothing, if the task isn't finished after the timeout. Rethrows the exception, if the task failed.
+    // The waiting thread runs other tasks meanwhile, so the wait may take longer than the timeout
+    std::optional<ResultType> WaitForTaskResult(std::chrono::steady_clock::duration timeout);
 
+    // Returns the task result, the task has to be finished already. Rethrows the exception, if the task failed
+    const ResultType& GetTaskResult() const
+    {
+        assert(HasTaskResult());
+        ThrowIfFailed();
         return task_result;
     }
 
     // Is connected task finished work and passed the result to the handle
     bool HasTaskResult() const override
     {
-        return has_result.load(std::memory_order_relaxed);
+        return has_result.load(std::memory_order_acquire);
+    }
+
+    // Runs func(result) as a new task, when this task is finished. Nothing is blocked in the meantime.
+    // If this task failed, the new one fails with the same exception
+    template<class Function>
+    auto Then(TaskPriority priority, Function&& func);
+
+    // Runs func(result) as a new task with normal priority, when this task is finished
+    template<class Function>
+    auto Then(Function&& func)
+    {
+        return Then(TaskPriority::Normal, std::forward<Function>(func));
+    }
+
+    TaskManager& GetManager() const
+    {
+        return manager;
     }
 
 protected:
     std::atomic_bool has_result = false;
     ResultType task_result;
 
-    std::function<void(const TaskHandleBase &)> wait_function;
+    TaskManager& manager;
 };
 
 // void specialization of the TaskHandle class
@@ -67,34 +109,63 @@ class TaskHandle<void> : public TaskHandleBase
 {
 
 public:
-    TaskHandle(const std::function<void(const TaskHandleBase &)> &wait_function)
-            : wait_function(wait_function) {}
+    explicit TaskHandle(TaskManager& owner_manager)
+            : manager(owner_manager) {}
 
     TaskHandle(const TaskHandle<void> &) = delete;
     TaskHandle(TaskHandle<void> &&) = delete;
 
-    // Marks that task finished work. Typically called by connected the task
+    // Marks that task finished work and runs continuations. Typically called by connected the task
     void MarkFinished()
     {
         assert(!is_finished.load(std::memory_order_relaxed));
         is_finished.store(true, std::memory_order_release);
+        RunContinuations();
     }
 
-    // Blocks current thread until the connected task is finished
-    void WaitForTaskResult()
+    // Finishes the handle with the exception thrown by the connected task. Waiting for the handle rethrows it
+    void SetTaskException(std::exception_ptr task_exception)
     {
-        while (!is_finished.load(std::memory_order_acquire))
-            wait_function(*this);
+        assert(!is_finished.load(std::memory_order_relaxed));
+
+        exception = std::move(task_exception);
+        is_finished.store(true, std::memory_order_release);
+        RunContinuations();
     }
 
+    // Blocks current thread until the connected task is finished. Rethrows the exception, if the task failed
+    void WaitForTaskResult();
+
+    // Blocks current thread until the connected task is finished or the timeout is over. Returns false on the timeout.
+    // Rethrows the exception, if the task failed.
+    // The waiting thread runs other tasks meanwhile, so the wait may take longer than the timeout
+    bool WaitForTaskResult(std::chrono::steady_clock::duration timeout);
+
     // Is connected task finished work and passed the result to the handle
     bool HasTaskResult() const override
     {
-        return is_finished.load(std::memory_order_relaxed);
+        return is_finished.load(std::memory_order_acquire);
+    }
+
+    // Runs func() as a new task, when this task is finished. Nothing is blocked in the meantime.
+    // If this task failed, the new one fails with the same exception
+    template<class Function>
+    auto Then(TaskPriority priority, Function&& func);
+
+    // Runs func() as a new task with normal priority, when this task is finished
+    template<class Function>
+    auto Then(Function&& func)
+    {
+        return Then(TaskPriority::Normal, std::forward<Function>(func));
+    }
+
+    TaskManager& GetManager() const
+    {
+        return manager;
     }
 
 protected:
     std::atomic_bool is_finished = false;
 
-    std::function<void(const TaskHandleBase &)> wait_function;
+    TaskManager& manager;
 };
\ No newline at end of file
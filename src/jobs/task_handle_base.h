@@ -14,10 +14,155 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "task_allocator.h"
+
 // Abstract templateless task handle class
-class TaskHandleBase
+class TaskHandleBase : public std::enable_shared_from_this<TaskHandleBase>
 {
 public:
+    TaskHandleBase() = default;
+    virtual ~TaskHandleBase();
+
+    TaskHandleBase(const TaskHandleBase&) = delete;
+    TaskHandleBase& operator=(const TaskHandleBase&) = delete;
+
     // Is connected task finished work and passed the result to the handle
     virtual bool HasTaskResult() const = 0;
+
+    // Is connected task dropped because of its cancellation token. The result of such task is default constructed
+    bool IsCancelled() const
+    {
+        return is_cancelled.load(std::memory_order_relaxed);
+    }
+
+    // Should be called before the result is passed to the handle, which publishes the flag
+    void MarkCancelled()
+    {
+        is_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    // Has connected task finished with an exception. The task has to be finished already
+    bool IsFailed() const
+    {
+        return static_cast<bool>(exception);
+    }
+
+    // Rethrows the exception of the connected task, if it failed. The task has to be finished already
+    void ThrowIfFailed() const
+    {
+        if(exception)
+            std::rethrow_exception(exception);
+    }
+
+    // Calls func on the thread which finishes the connected task, right after the result is passed to the handle.
+    // If the task is already finished, calls func immediately. Continuations have to be short, they delay the finishing thread
+    template<class Function>
+    void AddContinuation(Function&& func);
+
+protected:
+    // Calls continuations in the order they were added. Continuations added after that are called immediately
+    void RunContinuations();
+
+    // Written before the handle is finished, so it's published along with the result
+    std::exception_ptr exception;
+
+private:
+    class ContinuationBase
+    {
+    public:
+        virtual ~ContinuationBase() = default;
+        virtual void Run() = 0;
+
+        static void* operator new(size_t size) { return TaskAllocator::Allocate(size); }
+        static void operator delete(void* ptr, size_t size) { TaskAllocator::Deallocate(ptr, size); }
+
+        ContinuationBase* next = nullptr;
+    };
+
+    template<class Function>
+    class Continuation final : public ContinuationBase
+    {
+    public:
+        template<class FunctionArg>
+        explicit Continuation(FunctionArg&& func) : function(std::forward<FunctionArg>(func)) {}
+        void Run() override { function(); }
+
+    private:
+        Function function;
+    };
+
+    // Marks the list after the continuations were run
+    static ContinuationBase* GetClosedMarker()
+    {
+        return reinterpret_cast<ContinuationBase*>(uintptr_t(1));
+    }
+
+    // Lock-free stack of continuations waiting for the task
+    std::atomic<ContinuationBase*> continuations = nullptr;
+
+    std::atomic_bool is_cancelled = false;
 };
+
+inline TaskHandleBase::~TaskHandleBase()
+{
+    // Continuations of a task which never finished
+    ContinuationBase* continuation = continuations.load(std::memory_order_acquire);
+    if(continuation == GetClosedMarker())
+        return;
+
+    while(continuation)
+    {
+        auto* next = continuation->next;
+        delete continuation;
+        continuation = next;
+    }
+}
+
+template<class Function>
+void TaskHandleBase::AddContinuation(Function&& func)
+{
+    auto* continuation = new Continuation<std::decay_t<Function>>(std::forward<Function>(func));
+
+    ContinuationBase* head = continuations.load(std::memory_order_acquire);
+    while(head != GetClosedMarker())
+    {
+        continuation->next = head;
+        if(continuations.compare_exchange_weak(head, continuation, std::memory_order_release, std::memory_order_acquire))
+            return;
+    }
+
+    // The task is already finished
+    continuation->Run();
+    delete continuation;
+}
+
+inline void TaskHandleBase::RunContinuations()
+{
+    ContinuationBase* head = continuations.exchange(GetClosedMarker(), std::memory_order_acq_rel);
+    if(head == GetClosedMarker())
+        return;
+
+    // Continuations are stored in the reversed order
+    ContinuationBase* ordered = nullptr;
+    while(head)
+    {
+        auto* next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+    }
+
+    while(ordered)
+    {
+        auto* next = ordered->next;
+        ordered->Run();
+        delete ordered;
+        ordered = next;
+    }
+}
\ No newline at end of file
@@ -16,23 +16,84 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <stdexcept>
 #include <thread>
+#include "epoch_reclaimer.h"
+#include "task_profiler.h"
 #include "task_worker.h"
+#include "thread_utils.h"
 #include "locks/scoped_lock.h"
 #include "log.h"
 
-TaskManager::TaskManager()
-    : workers_lock("WorkersLock"), maxWorkersCount(CalcMaxWorkersCount())
+using Clock = std::chrono::steady_clock;
+
+// Tasks closer to the deadline than that are run before all other tasks
+static constexpr auto kUrgentDeadlineSlack = std::chrono::milliseconds(1);
+
+// Priority which didn't get a task for that long is checked before the higher ones, so under full load
+// each priority still gets at least one task per period. Indexed as AllTaskPriorities
+static constexpr std::array<Clock::duration, AllTaskPriorities.size()> kMaxWaitTimes =
 {
+    Clock::duration::max(),
+    std::chrono::milliseconds(2),
+    std::chrono::milliseconds(4),
+    std::chrono::milliseconds(8),
+    std::chrono::milliseconds(16),
+};
+
+// Last served time is written only when it's older than that, so workers don't fight over the cache line on every task
+static constexpr auto kServedTimeGranularity = std::chrono::milliseconds(1);
+
+// Time given to a worker to finish its current task on shut down
+static constexpr auto kWorkerStopTimeout = std::chrono::milliseconds(5000);
+
+// Manager of the pool the current worker thread belongs to
+static thread_local TaskManager* current_manager = nullptr;
+
+namespace
+{
+    // The main thread and its tasks are shared by all pools, so a task of any pool can be posted to it and awaited on it
+    struct MainThreadQueue
+    {
+        std::atomic<std::thread::id> thread_id;
+        // Executing tasks are swapped out, so the queue can be refilled while they run
+        SpinLock tasks_lock = SpinLock("MainThreadTasksLock");
+        std::vector<std::unique_ptr<TaskBase>> tasks;
+        std::vector<std::unique_ptr<TaskBase>> executing_tasks;
+        std::atomic_size_t tasks_count = 0;
+    };
+
+    MainThreadQueue& GetMainThreadQueue()
+    {
+        static MainThreadQueue queue;
+        return queue;
+    }
+}
+
+TaskManager::TaskManager(std::string pool_name, const Config& manager_config)
+    : workers_lock(pool_name + "WorkersLock"), name(std::move(pool_name)),
+      config(manager_config), maxWorkersCount(CalcMaxWorkersCount(manager_config))
+{
+    // Constructed before the first pool, so it outlives all of them
+    GetMainThreadQueue();
     assert(maxWorkersCount > 0);
     workers.reserve(maxWorkersCount);
-    free_workers.reserve(maxWorkersCount);
+
+    const unsigned cores_count = std::max(std::thread::hardware_concurrency(), 1u);
+    const unsigned reserved_cores = std::min(config.reserved_cores, cores_count - 1);
+    const auto idle_timeout = config.min_workers_count < maxWorkersCount ? config.idle_timeout : std::chrono::milliseconds::zero();
+    for(unsigned i = 0; i < maxWorkersCount; ++i)
+    {
+        const int core = config.pin_threads ? static_cast<int>(reserved_cores + i % (cores_count - reserved_cores)) : -1;
+        workers.emplace_back(new TaskWorker(i, name + " " + std::to_string(i), idle_timeout, core));
+    }
 
     for(unsigned i = 0; i < AllTaskPriorities.size(); ++i)
     {
         const auto priority = AllTaskPriorities[i];
         waiting_tasks[i].priority = priority;
-        waiting_tasks[i].lock.UpdateName(std::string(GetPriorityName(priority)) + "PriorityTasksLock");
+        waiting_tasks[i].lock.UpdateName(name + GetPriorityName(priority) + "PriorityTasksLock");
     }
 }
 
@@ -43,134 +104,666 @@ TaskManager::~TaskManager()
 
 TaskManager &TaskManager::GetInstance()
 {
-    static TaskManager manager;
+    static TaskManager manager("Compute", Config::FromEnvironment());
     return manager;
 }
 
+TaskManager &TaskManager::GetIOInstance()
+{
+    // I/O workers mostly wait, so there could be more of them than cores, and they are never pinned
+    Config defaults;
+    defaults.max_workers_count = 4;
+    defaults.min_workers_count = 0;
+    static TaskManager manager("IO", Config::FromEnvironment("SURFACEPP_IO_JOBS", defaults));
+    return manager;
+}
+
+TaskManager &TaskManager::GetCurrent()
+{
+    return current_manager ? *current_manager : GetInstance();
+}
+
+const std::string &TaskManager::GetName() const
+{
+    return name;
+}
+
+TaskManager::Config TaskManager::Config::FromEnvironment(const std::string& prefix)
+{
+    return FromEnvironment(prefix, Config());
+}
+
+TaskManager::Config TaskManager::Config::FromEnvironment(const std::string& prefix, const Config& defaults)
+{
+    Config result = defaults;
+
+    auto read_number = [&prefix](const char* variable_suffix, unsigned long default_value)
+    {
+        const std::string variable_name = prefix + variable_suffix;
+        const char* value = std::getenv(variable_name.c_str());
+        if(!value || *value == '\0')
+            return default_value;
+
+        char* end = nullptr;
+        const unsigned long number = std::strtoul(value, &end, 10);
+        if(*end != '\0')
+        {
+            log_warn("Ignoring %s=%s, a number is expected", variable_name.c_str(), value);
+            return default_value;
+        }
+        return number;
+    };
+
+    result.min_workers_count = static_cast<unsigned>(read_number("_MIN_WORKERS", result.min_workers_count));
+    result.max_workers_count = static_cast<unsigned>(read_number("_MAX_WORKERS", result.max_workers_count));
+    result.idle_timeout = std::chrono::milliseconds(read_number("_IDLE_TIMEOUT_MS", result.idle_timeout.count()));
+    result.pin_threads = read_number("_PIN_THREADS", result.pin_threads) != 0;
+    result.reserved_cores = static_cast<unsigned>(read_number("_RESERVED_CORES", result.reserved_cores));
+    return result;
+}
+
 void TaskManager::ShutDown()
 {
     ScopedLock scopeWorkersLock(workers_lock);
 
-    for(auto& worker : workers)
+    const unsigned started_count = started_workers_count.load(std::memory_order_acquire);
+    unsigned abandoned_count = 0;
+    for(unsigned i = 0; i < started_count; ++i)
     {
+        auto& worker = workers[i];
         worker->MarkStopped();
-        // If worker is waiting for a task, assign null task
-        auto free_worker = std::find(free_workers.begin(), free_workers.end(), worker.get());
-        if(free_worker != free_workers.end())
-        {
-            free_workers.erase(free_worker);
-            worker->AssignTask(nullptr);
-        }
+        // If worker is parked, wake it up to let it see the stop flag. Retired workers have no thread to stop
+        if(!worker->Unpark())
+            continue;
 
-        if(!worker->WaitForStop())
+        if(!worker->WaitForStop(kWorkerStopTimeout))
         {
+            // The thread still uses the worker, so it's leaked instead of being destroyed under the running task
             log_err("Worker %s refusing to shut down", worker->GetName().c_str());
+            worker.release();
+            ++abandoned_count;
         }
     }
 
-    free_workers.clear();
+    // Retired threads may be still on their way out
+    const auto wait_end = Clock::now() + kWorkerStopTimeout;
+    while(alive_threads_count.load(std::memory_order_acquire) > abandoned_count && Clock::now() < wait_end)
+        std::this_thread::yield();
+
+    free_workers_head.store(0, std::memory_order_relaxed);
     workers.clear();
+    started_workers_count.store(0, std::memory_order_release);
+    running_workers_count.store(0, std::memory_order_relaxed);
 }
 
-void TaskManager::WaitForTask(const TaskHandleBase &task_handle)
+bool TaskManager::WaitForTask(const TaskHandleBase &task_handle, Clock::time_point wait_end)
 {
+    // Workers of other pools keep to their own tasks, so e.g. a compute worker waiting for I/O doesn't block on another read
+    TaskManager& helped_manager = current_manager ? *current_manager : *this;
+
+    const bool is_main_thread = IsMainThread();
+    const bool has_timeout = wait_end != Clock::time_point::max();
     while (!task_handle.HasTaskResult())
     {
-        auto next_task = GetNextTask();
+        if(has_timeout && Clock::now() >= wait_end)
+            return false;
+
+        // The awaited task may be queued for the main thread itself
+        if(is_main_thread && ExecuteMainThreadTasks() > 0)
+            continue;
+
+        auto next_task = helped_manager.GetNextTask();
         if(next_task.has_value())
-            next_task.value()->RunTask();
+            helped_manager.ExecuteTask(*next_task.value());
         else
             std::this_thread::yield();
     }
+    return true;
 }
 
-void TaskManager::AddTask(std::unique_ptr<TaskBase> task, TaskPriority priority)
+void TaskManager::ExecuteTask(TaskBase &task)
 {
-    // Try to assign task to a worker immediately
+    if(!IsBackgroundPriority(task.priority) || background_budget_ns.load(std::memory_order_relaxed) == 0)
     {
-        ScopedLock scopeWorkersLock(workers_lock);
+        task.RunTask();
+        return;
+    }
+
+    const auto start = Clock::now();
+    task.RunTask();
+    frame_background_time_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(), std::memory_order_relaxed);
+}
+
+void TaskManager::SetBackgroundBudget(std::chrono::microseconds budget)
+{
+    background_budget_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(budget).count(), std::memory_order_relaxed);
+}
+
+void TaskManager::BeginFrame()
+{
+    EpochReclaimer::Collect();
+
+    const bool was_exhausted = IsBackgroundBudgetExhausted();
+    frame_background_time_ns.store(0, std::memory_order_relaxed);
+    if(!was_exhausted)
+        return;
+
+    // Workers could park while background tasks were waiting for the budget
+    const auto stats = GetStats();
+    size_t background_tasks_count = 0;
+    for(const auto priority : AllTaskPriorities)
+    {
+        if(IsBackgroundPriority(priority))
+            background_tasks_count += stats.queue_depth[GetPriorityIndex(priority)];
+    }
+
+    for(size_t i = 0; i < std::min<size_t>(background_tasks_count, maxWorkersCount); ++i)
+        NotifyWorker();
+}
 
-        // Instantly assign task, if there is any free workers
-        if (!free_workers.empty())
+void TaskManager::BindMainThread()
+{
+    GetMainThreadQueue().thread_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    if(config.pin_threads && config.reserved_cores > 0)
+        PinCurrentThreadToCore(0);
+}
+
+bool TaskManager::IsMainThread() const
+{
+    return GetMainThreadQueue().thread_id.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+size_t TaskManager::ExecuteMainThreadTasks()
+{
+    assert(IsMainThread());
+
+    auto& queue = GetMainThreadQueue();
+    if(queue.tasks_count.load(std::memory_order_acquire) == 0)
+        return 0;
+
+    // Tasks could be added to the queue while the previous batch is executed, so the executing tasks are taken out of it
+    std::vector<std::unique_ptr<TaskBase>> tasks = std::move(queue.executing_tasks);
+    {
+        ScopedLock scopeTasksLock(queue.tasks_lock);
+        std::swap(tasks, queue.tasks);
+        queue.tasks_count.store(0, std::memory_order_relaxed);
+    }
+
+    for(auto& task : tasks)
+    {
+        ExecuteTask(*task);
+        task.reset();
+    }
+
+    const size_t executed_count = tasks.size();
+    // Keeps the capacity, so the queue doesn't allocate in the steady state
+    tasks.clear();
+    queue.executing_tasks = std::move(tasks);
+    return executed_count;
+}
+
+bool TaskManager::IsBackgroundBudgetExhausted() const
+{
+    const auto budget = background_budget_ns.load(std::memory_order_relaxed);
+    return budget != 0 && frame_background_time_ns.load(std::memory_order_relaxed) >= budget;
+}
+
+std::shared_ptr<TaskHandle<void>> TaskManager::WhenAll(const std::vector<std::shared_ptr<TaskHandleBase>> &handles)
+{
+    auto result = MakeHandle<void>();
+    if (handles.empty())
+    {
+        result->MarkFinished();
+        return result;
+    }
+
+    auto remaining_count = std::allocate_shared<std::atomic_size_t>(TaskPoolAllocator<std::atomic_size_t>(), handles.size());
+    for (const auto& handle : handles)
+    {
+        // Continuation keeps the handle alive until it's finished, even if nobody else holds it
+        handle->AddContinuation([result, remaining_count, handle]
         {
-            auto worker = free_workers.back();
-            free_workers.pop_back();
-            worker->AssignTask(std::move(task));
-            return;
-        }
+            if (remaining_count->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                result->MarkFinished();
+        });
+    }
+
+    return result;
+}
+
+std::shared_ptr<TaskHandle<size_t>> TaskManager::WhenAny(const std::vector<std::shared_ptr<TaskHandleBase>> &handles)
+{
+    assert(!handles.empty());
 
-        // Create new worker and assign task to it, if we can
-        if (workers.size() < maxWorkersCount)
+    auto result = MakeHandle<size_t>();
+    auto is_finished = std::allocate_shared<std::atomic_bool>(TaskPoolAllocator<std::atomic_bool>(), false);
+    for (size_t i = 0; i < handles.size(); ++i)
+    {
+        handles[i]->AddContinuation([result, is_finished, i, handle = handles[i]]
+        {
+            if (!is_finished->exchange(true, std::memory_order_acq_rel))
+                result->SetTaskResult(size_t(i));
+        });
+    }
+
+    return result;
+}
+
+TaskManager::Stats TaskManager::GetStats() const
+{
+    Stats result;
+    result.started_workers_count = started_workers_count.load(std::memory_order_acquire);
+    result.running_workers_count = running_workers_count.load(std::memory_order_relaxed);
+
+    for(size_t i = 0; i < AllTaskPriorities.size(); ++i)
+    {
+        result.queue_depth[i] = waiting_tasks[i].tasks_count.load(std::memory_order_relaxed)
+                              + waiting_tasks[i].deadline_tasks_count.load(std::memory_order_relaxed);
+    }
+
+    for(unsigned i = 0; i < result.started_workers_count; ++i)
+    {
+        const auto& worker = workers[i];
+        for(size_t j = 0; j < AllTaskPriorities.size(); ++j)
+            result.queue_depth[j] += worker->GetTasksCount(AllTaskPriorities[j]);
+
+        result.steals_count += worker->GetStolenTasksCount();
+        result.idle_time += worker->GetIdleTime();
+    }
+
+    return result;
+}
+
+void TaskManager::AddTask(std::unique_ptr<TaskBase> task, TaskPriority priority)
+{
+    task->priority = priority;
+    if (TaskProfiler::IsEnabled())
+        task->enqueue_time = TaskProfiler::Clock::now();
+
+    // Deadline tasks have to be visible to all workers to be ordered, so they always go to the shared queue
+    if (task->deadline != Clock::time_point::max())
+    {
         {
-            auto *newWorker = new TaskWorker();
-            workers.emplace_back(newWorker);
+            auto& container = GetTasksForPriority(priority);
+            ScopedLock scopeTasksLock(container.lock);
+            container.PushWithDeadline(std::move(task));
+        }
 
-            auto workerThread = std::thread(&TaskWorker::StartWorker, newWorker, std::move(task),
-                                            [this] { return GetNextTask(); },
-                                            [this](TaskWorker *worker) { return AddFreeWorker(worker); });
-            workerThread.detach();
+        NotifyWorker();
+        return;
+    }
+
+    // Worker threads push to their own deque without any contention, idle workers will steal from it
+    if (auto* current_worker = GetCurrentWorker())
+    {
+        current_worker->PushTask(std::move(task), priority);
+        NotifyWorker();
+        return;
+    }
 
+    // Create new worker and give the task to it directly, if no one is free and we can
+    if (free_workers_head.load(std::memory_order_relaxed) == 0
+        && started_workers_count.load(std::memory_order_relaxed) < maxWorkersCount)
+    {
+        ScopedLock scopeWorkersLock(workers_lock);
+        if (started_workers_count.load(std::memory_order_relaxed) < maxWorkersCount)
+        {
+            StartNewWorker(std::move(task));
             return;
         }
     }
 
-    // Put a task in the queue, if no worker can run it now
+    // Put a task in the queue, a free worker will pick it up
+    {
+        auto& container = GetTasksForPriority(priority);
+        ScopedLock scopeTasksLock(container.lock);
+        container.Push(std::move(task));
+    }
+
+    NotifyWorker();
+}
+
+void TaskManager::AddMainThreadTask(std::unique_ptr<TaskBase> task)
+{
+    // Nobody would ever run the task, and waiting for it would hang
+    auto& queue = GetMainThreadQueue();
+    if(queue.thread_id.load(std::memory_order_relaxed) == std::thread::id())
+    {
+        log_err("No main thread is bound, can't queue a main thread task of %s", name.c_str());
+        throw std::logic_error("main thread task is posted before BindMainThread");
+    }
+
+    if (TaskProfiler::IsEnabled())
+        task->enqueue_time = TaskProfiler::Clock::now();
+
+    ScopedLock scopeTasksLock(queue.tasks_lock);
+    queue.tasks.push_back(std::move(task));
+    queue.tasks_count.store(queue.tasks.size(), std::memory_order_release);
+}
+
+void TaskManager::RequeueTask(std::unique_ptr<TaskBase> task, TaskPriority priority)
+{
+    task->priority = priority;
+    if (TaskProfiler::IsEnabled())
+        task->enqueue_time = TaskProfiler::Clock::now();
+
     {
         auto& container = GetTasksForPriority(priority);
         ScopedLock scopeTasksLock(container.lock);
-        container.tasks.push_back(std::move(task));
+        if (task->deadline != Clock::time_point::max())
+            container.PushWithDeadline(std::move(task));
+        else
+            container.Push(std::move(task));
     }
+
+    NotifyWorker();
 }
 
-bool TaskManager::AddFreeWorker(TaskWorker *worker)
+void TaskManager::AddFreeWorker(TaskWorker *worker)
 {
-    if(!workers_lock.TryAcquire())
-        return false;
-    ScopedLock scopeWorkersLock(workers_lock, true);
+    if(worker->is_free.exchange(true, std::memory_order_relaxed))
+        return;
 
-    free_workers.push_back(worker);
-    return true;
+    const uint64_t worker_link = worker->GetIndex() + 1;
+    uint64_t head = free_workers_head.load(std::memory_order_relaxed);
+    do
+    {
+        worker->next_free_worker.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    }
+    while(!free_workers_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | worker_link,
+                                                   std::memory_order_seq_cst, std::memory_order_relaxed));
+}
+
+TaskWorker *TaskManager::PopFreeWorker()
+{
+    uint64_t head = free_workers_head.load(std::memory_order_acquire);
+    while(static_cast<uint32_t>(head) != 0)
+    {
+        TaskWorker* worker = workers[static_cast<uint32_t>(head) - 1].get();
+        const uint64_t next_link = worker->next_free_worker.load(std::memory_order_relaxed);
+        // The counter in high bits makes CAS fail, if the stack was changed in between, even when the same worker is on the top
+        if(free_workers_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | next_link,
+                                                   std::memory_order_acquire, std::memory_order_acquire))
+        {
+            worker->is_free.store(false, std::memory_order_relaxed);
+            return worker;
+        }
+    }
+
+    return nullptr;
 }
 
 std::optional<std::unique_ptr<TaskBase>> TaskManager::GetNextTask()
 {
-    for(auto& tasks : waiting_tasks)
+    auto* current_worker = GetCurrentWorker();
+    const auto now = Clock::now();
+
+    if(auto task = PopUrgentTask(now))
+        return task;
+
+    // Aging: a priority which wasn't served for too long goes first, so lower priorities always make progress.
+    // Lowest priorities are checked first, since they have the longest wait limits
+    for(size_t i = waiting_tasks.size(); i-- > 1;)
     {
-        if (!tasks.lock.TryAcquire())
+        auto& tasks = waiting_tasks[i];
+        if(now - Clock::time_point(Clock::duration(tasks.last_served_time.load(std::memory_order_relaxed))) < kMaxWaitTimes[i])
             continue;
 
-        ScopedLock scopeTasksLock(tasks.lock, true);
-        if(tasks.tasks.empty())
+        if(auto task = GetTaskForPriority(tasks, current_worker, now))
+            return task;
+
+        // Nothing is waiting, so the priority isn't starving
+        tasks.last_served_time.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    const bool is_background_budget_exhausted = IsBackgroundBudgetExhausted();
+    for(auto& tasks : waiting_tasks)
+    {
+        if(is_background_budget_exhausted && IsBackgroundPriority(tasks.priority))
             continue;
 
-        auto result = std::move(tasks.tasks.back());
-        tasks.tasks.pop_back();
-        return result;
+        if(auto task = GetTaskForPriority(tasks, current_worker, now))
+            return task;
     }
 
     return {};
 }
 
-TaskManager::TasksContainer &TaskManager::GetTasksForPriority(TaskPriority priority)
+std::unique_ptr<TaskBase> TaskManager::GetTaskForPriority(TasksContainer &tasks, TaskWorker *current_worker, Clock::time_point now)
 {
+    std::unique_ptr<TaskBase> task;
+    if(current_worker)
+        task = current_worker->PopTask(tasks.priority);
+
+    if(!task)
+        task = PopWaitingTask(tasks);
+
+    if(!task)
+        task = StealTask(tasks.priority, current_worker);
+
+    if(task)
+    {
+        const auto now_ticks = now.time_since_epoch().count();
+        if(now_ticks - tasks.last_served_time.load(std::memory_order_relaxed) > Clock::duration(kServedTimeGranularity).count())
+            tasks.last_served_time.store(now_ticks, std::memory_order_relaxed);
+    }
+
+    return task;
+}
+
+std::unique_ptr<TaskBase> TaskManager::PopUrgentTask(Clock::time_point now)
+{
+    const auto urgent_ticks = (now + kUrgentDeadlineSlack).time_since_epoch().count();
     for(auto& tasks : waiting_tasks)
     {
-        if(tasks.priority == priority)
-            return tasks;
+        if(tasks.earliest_deadline.load(std::memory_order_relaxed) > urgent_ticks)
+            continue;
+
+        if(!tasks.lock.TryAcquire())
+            continue;
+
+        ScopedLock scopeTasksLock(tasks.lock, true);
+        if(tasks.earliest_deadline.load(std::memory_order_relaxed) <= urgent_ticks)
+            return tasks.PopEarliestDeadline();
     }
 
-    assert(false); // Shouldn't hit that
-    return waiting_tasks[0];
+    return nullptr;
+}
+
+TaskManager::TasksContainer &TaskManager::GetTasksForPriority(TaskPriority priority)
+{
+    return waiting_tasks[GetPriorityIndex(priority)];
+}
+
+std::unique_ptr<TaskBase> TaskManager::PopWaitingTask(TaskManager::TasksContainer &tasks)
+{
+    if(tasks.IsEmpty())
+        return nullptr;
+
+    if(!tasks.lock.TryAcquire())
+        return nullptr;
+
+    ScopedLock scopeTasksLock(tasks.lock, true);
+    return tasks.Pop();
 }
 
-unsigned int TaskManager::CalcMaxWorkersCount()
+std::unique_ptr<TaskBase> TaskManager::StealTask(TaskPriority priority, const TaskWorker *thief)
 {
+    const unsigned started_count = started_workers_count.load(std::memory_order_acquire);
+    if(started_count == 0)
+        return nullptr;
+
+    // Start from the neighbour of the thief, so workers don't all rob the same victim
+    const unsigned first_victim = thief ? thief->GetIndex() + 1 : 0;
+    for(unsigned i = 0; i < started_count; ++i)
+    {
+        auto& victim = workers[(first_victim + i) % started_count];
+        if(victim.get() == thief || !victim->HasTasks(priority))
+            continue;
+
+        if(auto task = victim->StealTask(priority))
+            return task;
+    }
+
+    return nullptr;
+}
+
+TaskWorker *TaskManager::GetCurrentWorker() const
+{
+    return current_manager == this ? TaskWorker::GetCurrent() : nullptr;
+}
+
+void TaskManager::NotifyWorker()
+{
+    // Pairs with the fence in TaskWorker::StartWorker: either the worker sees the new task, or we see the worker
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (auto* free_worker = PopFreeWorker())
+    {
+        if (!free_worker->Unpark())
+            RestartWorker(free_worker);
+        return;
+    }
+
+    if (started_workers_count.load(std::memory_order_relaxed) >= maxWorkersCount)
+        return;
+
+    ScopedLock scopeWorkersLock(workers_lock);
+    if (started_workers_count.load(std::memory_order_relaxed) < maxWorkersCount)
+        StartNewWorker(nullptr);
+}
+
+void TaskManager::StartNewWorker(std::unique_ptr<TaskBase> first_task)
+{
+    auto* newWorker = workers[started_workers_count.load(std::memory_order_relaxed)].get();
+    running_workers_count.fetch_add(1, std::memory_order_relaxed);
+    StartWorkerThread(newWorker, std::move(first_task));
+
+    started_workers_count.fetch_add(1, std::memory_order_release);
+}
+
+void TaskManager::RestartWorker(TaskWorker *worker)
+{
+    running_workers_count.fetch_add(1, std::memory_order_relaxed);
+    StartWorkerThread(worker, nullptr);
+}
+
+void TaskManager::StartWorkerThread(TaskWorker *worker, std::unique_ptr<TaskBase> first_task)
+{
+    alive_threads_count.fetch_add(1, std::memory_order_relaxed);
+
+    auto workerThread = std::thread([this, worker, first_task = std::move(first_task)]() mutable
+    {
+        current_manager = this;
+        worker->StartWorker(std::move(first_task),
+                            [this] { return GetNextTask(); },
+                            [this](TaskBase &task) { ExecuteTask(task); },
+                            [this](TaskWorker *free_worker) { AddFreeWorker(free_worker); },
+                            [this](TaskWorker *idle_worker) { return RetireWorker(idle_worker); });
+
+        // The last access to the manager, ShutDown waits for it before destroying the workers
+        alive_threads_count.fetch_sub(1, std::memory_order_release);
+    });
+    workerThread.detach();
+}
+
+bool TaskManager::RetireWorker(TaskWorker *worker)
+{
+    // Reserve the retirement first, so concurrently retiring workers don't go below the minimum
+    unsigned running_count = running_workers_count.load(std::memory_order_relaxed);
+    do
+    {
+        if(running_count <= config.min_workers_count)
+            return false;
+    }
+    while(!running_workers_count.compare_exchange_weak(running_count, running_count - 1, std::memory_order_relaxed));
+
+    if(worker->TryRetire())
+        return true;
+
+    running_workers_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+unsigned int TaskManager::CalcMaxWorkersCount(const Config& config)
+{
+    if (config.max_workers_count > 0)
+        return config.max_workers_count;
+
     const auto result = std::thread::hardware_concurrency();
     if (result == 0)
         return 4; // 4 threads by default
+    if (config.pin_threads && result > config.reserved_cores)
+        return result - config.reserved_cores;
     return result;
 }
 
+static bool HasLaterDeadline(const std::unique_ptr<TaskBase>& first, const std::unique_ptr<TaskBase>& second)
+{
+    return first->deadline > second->deadline;
+}
+
 TaskManager::TasksContainer::TasksContainer()
 : lock("TasksLock"), priority(TaskPriority::Normal)
-{}
\ No newline at end of file
+{}
+
+void TaskManager::TasksContainer::Push(std::unique_ptr<TaskBase> task)
+{
+    const size_t count = tasks_count.load(std::memory_order_relaxed);
+    if(count == tasks.size())
+    {
+        // Unroll the ring into a bigger buffer
+        std::vector<std::unique_ptr<TaskBase>> new_tasks(std::max<size_t>(16, tasks.size() * 2));
+        for(size_t i = 0; i < count; ++i)
+            new_tasks[i] = std::move(tasks[(first_task + i) % tasks.size()]);
+        tasks = std::move(new_tasks);
+        first_task = 0;
+    }
+
+    tasks[(first_task + count) % tasks.size()] = std::move(task);
+    tasks_count.store(count + 1, std::memory_order_release);
+}
+
+void TaskManager::TasksContainer::PushWithDeadline(std::unique_ptr<TaskBase> task)
+{
+    deadline_tasks.push_back(std::move(task));
+    std::push_heap(deadline_tasks.begin(), deadline_tasks.end(), HasLaterDeadline);
+
+    deadline_tasks_count.store(deadline_tasks.size(), std::memory_order_release);
+    earliest_deadline.store(deadline_tasks.front()->deadline.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+std::unique_ptr<TaskBase> TaskManager::TasksContainer::PopEarliestDeadline()
+{
+    if(deadline_tasks.empty())
+        return nullptr;
+
+    std::pop_heap(deadline_tasks.begin(), deadline_tasks.end(), HasLaterDeadline);
+    auto result = std::move(deadline_tasks.back());
+    deadline_tasks.pop_back();
+
+    deadline_tasks_count.store(deadline_tasks.size(), std::memory_order_release);
+    earliest_deadline.store((deadline_tasks.empty() ? Clock::time_point::max() : deadline_tasks.front()->deadline).time_since_epoch().count(),
+                            std::memory_order_relaxed);
+    return result;
+}
+
+bool TaskManager::TasksContainer::IsEmpty() const
+{
+    return tasks_count.load(std::memory_order_acquire) == 0 && deadline_tasks_count.load(std::memory_order_acquire) == 0;
+}
+
+std::unique_ptr<TaskBase> TaskManager::TasksContainer::Pop()
+{
+    if(auto task = PopEarliestDeadline())
+        return task;
+
+    const size_t count = tasks_count.load(std::memory_order_relaxed);
+    if(count == 0)
+        return nullptr;
+
+    auto result = std::move(tasks[first_task]);
+    first_task = (first_task + 1) % tasks.size();
+    tasks_count.store(count - 1, std::memory_order_release);
+    return result;
+}
\ No newline at end of file
@@ -16,10 +16,20 @@
 
 #include <atomic>
 #include <array>
+#include <chrono>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <optional>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
+#include "cancellation_token.h"
+#include "parallel_for.h"
+#include "sliced_task.h"
+#include "task_allocator.h"
 #include "task_handle.h"
 #include "task.h"
 #include "locks/spin_lock.h"
@@ -28,17 +38,78 @@ class TaskWorker;
 
 class TaskManager
 {
-private:
-    TaskManager();
-
 public:
+    struct Config
+    {
+        // Zero means the count of hardware threads, minus the reserved cores when the threads are pinned
+        unsigned max_workers_count = 0;
+        // Workers above this count are stopped, when they are idle for idle_timeout. Zero timeout means never
+        unsigned min_workers_count = 1;
+        std::chrono::milliseconds idle_timeout = std::chrono::seconds(10);
+        // Pins each worker to a core. The first reserved_cores cores are left to the main thread
+        bool pin_threads = false;
+        unsigned reserved_cores = 1;
+
+        // Default config overridden by <prefix>_MIN_WORKERS, <prefix>_MAX_WORKERS, <prefix>_IDLE_TIMEOUT_MS,
+        // <prefix>_PIN_THREADS and <prefix>_RESERVED_CORES environment variables
+        static Config FromEnvironment(const std::string& prefix, const Config& defaults);
+        static Config FromEnvironment(const std::string& prefix = "SURFACEPP_JOBS");
+    };
+
+    // Independent pool of workers with its own queues. Worker threads are named after the pool
+    TaskManager(std::string pool_name, const Config& config);
+
     TaskManager(const TaskManager&) = delete;
     TaskManager(TaskManager&&) = delete;
 
     ~TaskManager();
 
+    // Pool for the computations, frame-critical tasks go here. Configured by SURFACEPP_JOBS_* environment variables
     static TaskManager& GetInstance();
 
+    // Pool for the tasks which block on file or network I/O, so they don't hold the compute workers.
+    // Configured by SURFACEPP_IO_JOBS_* environment variables
+    static TaskManager& GetIOInstance();
+
+    // Pool of the worker running on the current thread, the compute pool on the other threads
+    static TaskManager& GetCurrent();
+
+    const std::string& GetName() const;
+
+    struct Stats
+    {
+        // Count of tasks waiting in the shared queues and in the worker deques for each of AllTaskPriorities
+        std::array<size_t, AllTaskPriorities.size()> queue_depth = {};
+        // Count of tasks taken from the deques of other workers
+        uint64_t steals_count = 0;
+        // Total time the workers spent parked
+        std::chrono::nanoseconds idle_time = std::chrono::nanoseconds::zero();
+        unsigned started_workers_count = 0;
+        // Started workers, which haven't retired
+        unsigned running_workers_count = 0;
+    };
+
+    // Snapshot of the scheduler counters. Values are approximate, since workers keep running while they are collected
+    Stats GetStats() const;
+
+    // Limits the time workers spend on background (Low and VeryLow) tasks during a frame. Zero means no limit.
+    // Starved background tasks are still run now and then, when the budget is exhausted
+    void SetBackgroundBudget(std::chrono::microseconds budget);
+
+    // Starts a new frame for the background budget of this pool. Should be called once per frame by the main loop for every pool
+    // with a budget. The frame index of the TaskGroups is process-wide and is advanced by FrameArena::BeginFrame instead
+    void BeginFrame();
+
+    // Makes the current thread the main thread, the one RunOnMainThread tasks are run on. The main thread and its queue are
+    // shared by all pools, so it's enough to bind it on one of them. When the threads of this pool are pinned,
+    // the main thread gets the first reserved core
+    void BindMainThread();
+
+    bool IsMainThread() const;
+
+    // Runs tasks queued with RunOnMainThread of any pool before this call. Must be called on the main thread. Returns the count of run tasks
+    size_t ExecuteMainThreadTasks();
+
     //~ Templates magic. Hurts to understand
     template<class Function, class... Args>
     using ResultType = std::invoke_result_t<std::decay_t<Function>, std::decay_t<Args>...>;
@@ -47,12 +118,8 @@ public:
     template<class Function, class... Args>
     std::shared_ptr<TaskHandle<TaskManager::ResultType<Function, Args...>>> RunTask(TaskPriority priority, Function&& func, Args&&... args)
     {
-        using TaskResultType = ResultType<Function, Args...>;
-
-        auto handle = std::make_shared<TaskHandle<TaskResultType>>(std::bind(&TaskManager::WaitForTask, this, std::placeholders::_1));
-        auto bound_func = std::bind(std::forward<Function>(func), std::forward<Args>(args)...);
-        Task<TaskResultType>* task = new Task<TaskResultType>(bound_func, handle);
-        AddTask(std::unique_ptr<TaskBase>(task), priority);
+        auto [handle, task] = CreateTask(std::forward<Function>(func), std::forward<Args>(args)...);
+        AddTask(std::move(task), priority);
         return handle;
     }
 
@@ -63,6 +130,73 @@ public:
         return RunTask(TaskPriority::Normal, std::forward<Function>(func), std::forward<Args>(args)...);
     }
 
+    // Puts task to the execution queue. If the token is cancelled before the task is started, the task is dropped without running,
+    // and its handle is finished with a default constructed result and IsCancelled() set. Running tasks are never interrupted
+    template<class Function, class... Args>
+    std::shared_ptr<TaskHandle<TaskManager::ResultType<Function, Args...>>> RunCancellableTask(TaskPriority priority, const CancellationToken& token,
+                                                                                             Function&& func, Args&&... args)
+    {
+        using TaskResultType = ResultType<Function, Args...>;
+
+        auto handle = MakeHandle<TaskResultType>();
+        auto guarded_func = [token, weak_handle = std::weak_ptr<TaskHandle<TaskResultType>>(handle),
+                             bound_func = std::bind(std::forward<Function>(func), std::forward<Args>(args)...)]() mutable -> TaskResultType
+        {
+            if (!token.IsCancelled())
+                return bound_func();
+
+            if (auto shared_handle = weak_handle.lock())
+                shared_handle->MarkCancelled();
+            return TaskResultType();
+        };
+        AddTask(std::unique_ptr<TaskBase>(new Task<TaskResultType, decltype(guarded_func)>(std::move(guarded_func), handle)), priority);
+        return handle;
+    }
+
+    // Puts task to the execution queue. It's run before the tasks of the same priority with a later deadline or without one,
+    // and before the tasks of any priority, when the deadline is close. Missed deadlines don't cancel the task
+    template<class Function, class... Args>
+    std::shared_ptr<TaskHandle<TaskManager::ResultType<Function, Args...>>> RunTaskWithDeadline(TaskPriority priority, std::chrono::steady_clock::time_point deadline,
+                                                                                              Function&& func, Args&&... args)
+    {
+        auto [handle, task] = CreateTask(std::forward<Function>(func), std::forward<Args>(args)...);
+        task->deadline = deadline;
+        AddTask(std::move(task), priority);
+        return handle;
+    }
+
+    // Puts task to the queue of the main thread, which owns the GL context. It's run by ExecuteMainThreadTasks,
+    // so it's safe to create buffers and textures in it. Waiting for the handle on the main thread runs the queue too.
+    // Throws std::logic_error if BindMainThread wasn't called
+    template<class Function, class... Args>
+    std::shared_ptr<TaskHandle<TaskManager::ResultType<Function, Args...>>> RunOnMainThread(Function&& func, Args&&... args)
+    {
+        auto [handle, task] = CreateTask(std::forward<Function>(func), std::forward<Args>(args)...);
+        AddMainThreadTask(std::move(task));
+        return handle;
+    }
+
+    // Puts a long job to the execution queue, which is done in slices. func(TaskSlice&) is called again and again, until it returns true,
+    // and should return soon after the slice is expired. Between the calls the task goes to the back of the queue, so the other tasks go on
+    template<class Function>
+    std::shared_ptr<SlicedTaskHandle> RunSlicedTask(TaskPriority priority, std::chrono::microseconds slice_budget, Function&& func)
+    {
+        auto handle = std::allocate_shared<SlicedTaskHandle>(TaskPoolAllocator<SlicedTaskHandle>(), *this);
+        AddTask(std::unique_ptr<TaskBase>(new SlicedTask<std::decay_t<Function>>(*this, std::forward<Function>(func), handle, slice_budget, false)), priority);
+        return handle;
+    }
+
+    // Puts a long job to the queue of the main thread, which is done in slices. Every ExecuteMainThreadTasks call runs one slice of it,
+    // so the job is spread across the frames. Waiting for the handle on the main thread runs all the slices at once.
+    // Throws std::logic_error if BindMainThread wasn't called
+    template<class Function>
+    std::shared_ptr<SlicedTaskHandle> RunSlicedOnMainThread(std::chrono::microseconds slice_budget, Function&& func)
+    {
+        auto handle = std::allocate_shared<SlicedTaskHandle>(TaskPoolAllocator<SlicedTaskHandle>(), *this);
+        AddMainThreadTask(std::unique_ptr<TaskBase>(new SlicedTask<std::decay_t<Function>>(*this, std::forward<Function>(func), handle, slice_budget, true)));
+        return handle;
+    }
+
     // Puts task to the execution queue and waits for the result
     template<class Function, class... Args>
     TaskManager::ResultType<Function, Args...> RunAndWaitForTask(TaskPriority priority, Function&& func, Args&&... args)
@@ -78,40 +212,326 @@ public:
         return RunAndWaitForTask(TaskPriority::Normal, std::forward<Function>(func), std::forward<Args>(args)...);
     }
 
+    // Calls func(index) for every index in [begin, end) on several workers. Chunks are never smaller than grain.
+    // The calling thread processes the range too and returns when all indices are processed.
+    // If func throws, the rest of the range is skipped and the first exception is rethrown
+    template<class IndexType, class Function>
+    void ParallelFor(TaskPriority priority, IndexType begin, IndexType end, IndexType grain, Function&& func)
+    {
+        if(begin >= end)
+            return;
+
+        using State = ParallelForState<IndexType, std::remove_reference_t<Function>>;
+
+        const unsigned participants_count = maxWorkersCount + 1;
+        auto state = std::allocate_shared<State>(TaskPoolAllocator<State>(), begin, end, grain, participants_count, func);
+
+        // No need to wake more helpers than there are chunks
+        const IndexType chunks_count = (end - begin + std::max<IndexType>(grain, 1) - 1) / std::max<IndexType>(grain, 1);
+        const unsigned helpers_count = static_cast<unsigned>(std::min<IndexType>(chunks_count - 1, maxWorkersCount));
+        for(unsigned i = 0; i < helpers_count; ++i)
+        {
+            auto helper = [state] { while(state->ProcessChunk()) {} };
+            AddTask(std::unique_ptr<TaskBase>(new Task<void, decltype(helper)>(std::move(helper), {})), priority);
+        }
+
+        while(state->ProcessChunk()) {}
+
+        // Chunks claimed by helpers may be still in progress
+        WaitForTask(*state);
+        state->ThrowIfFailed();
+    }
+
+    // Calls func(index) for every index in [begin, end) on several workers with normal priority
+    template<class IndexType, class Function>
+    void ParallelFor(IndexType begin, IndexType end, IndexType grain, Function&& func)
+    {
+        ParallelFor(TaskPriority::Normal, begin, end, grain, std::forward<Function>(func));
+    }
+
+    // Calls func(item) for every item of the random access container on several workers
+    template<class Container, class Function>
+    void ParallelForEach(TaskPriority priority, Container& container, Function&& func, size_t grain = 1)
+    {
+        auto first = std::begin(container);
+        ParallelFor(priority, size_t(0), static_cast<size_t>(std::size(container)), grain,
+                    [&first, &func](size_t index) { func(first[index]); });
+    }
+
+    // Calls func(item) for every item of the random access container on several workers with normal priority
+    template<class Container, class Function>
+    void ParallelForEach(Container& container, Function&& func, size_t grain = 1)
+    {
+        ParallelForEach(TaskPriority::Normal, container, std::forward<Function>(func), grain);
+    }
+
+    // Returns a handle which is finished, when all the given handles are finished
+    template<class... Handles>
+    std::shared_ptr<TaskHandle<void>> WhenAll(const std::shared_ptr<Handles>&... handles)
+    {
+        return WhenAll(std::vector<std::shared_ptr<TaskHandleBase>>{ handles... });
+    }
+
+    // Returns a handle which is finished, when all the given handles are finished
+    std::shared_ptr<TaskHandle<void>> WhenAll(const std::vector<std::shared_ptr<TaskHandleBase>>& handles);
+
+    // Returns a handle with the index of the first finished handle among the given ones
+    template<class... Handles>
+    std::shared_ptr<TaskHandle<size_t>> WhenAny(const std::shared_ptr<Handles>&... handles)
+    {
+        return WhenAny(std::vector<std::shared_ptr<TaskHandleBase>>{ handles... });
+    }
+
+    // Returns a handle with the index of the first finished handle among the given ones
+    std::shared_ptr<TaskHandle<size_t>> WhenAny(const std::vector<std::shared_ptr<TaskHandleBase>>& handles);
+
+    // Puts task to the execution queue, when the dependency is finished
+    template<class Function, class... Args>
+    std::shared_ptr<TaskHandle<TaskManager::ResultType<Function, Args...>>> RunTaskAfter(const std::shared_ptr<TaskHandleBase>& dependency, TaskPriority priority,
+                                                                                       Function&& func, Args&&... args)
+    {
+        auto [handle, task] = CreateTask(std::forward<Function>(func), std::forward<Args>(args)...);
+        // Continuation keeps the dependency alive until it's finished, even if nobody else holds its handle
+        dependency->AddContinuation([this, priority, task = std::move(task), dependency]() mutable { AddTask(std::move(task), priority); });
+        return handle;
+    }
+
 protected:
+    template<class> friend class TaskHandle;
+    template<class> friend class SlicedTask;
+    friend class TaskGroup;
+
+    // Creates a handle and a task, which is not queued yet
+    template<class Function, class... Args>
+    auto CreateTask(Function&& func, Args&&... args)
+    {
+        using TaskResultType = ResultType<Function, Args...>;
+        using BoundFunction = decltype(std::bind(std::forward<Function>(func), std::forward<Args>(args)...));
+
+        // Both handle and task come from the TaskAllocator pool
+        auto handle = MakeHandle<TaskResultType>();
+        std::unique_ptr<TaskBase> task(new Task<TaskResultType, BoundFunction>(std::bind(std::forward<Function>(func), std::forward<Args>(args)...), handle));
+        return std::make_pair(std::move(handle), std::move(task));
+    }
+
+    template<class HandleResultType>
+    std::shared_ptr<TaskHandle<HandleResultType>> MakeHandle()
+    {
+        return std::allocate_shared<TaskHandle<HandleResultType>>(TaskPoolAllocator<TaskHandle<HandleResultType>>(), *this);
+    }
 
     void ShutDown();
 
-    // Blocks current thread until task with this handle will be finished (handle.HasTaskResult() is true)
-    void WaitForTask(const TaskHandleBase& task_handle);
+    // Blocks current thread until task with this handle will be finished (handle.HasTaskResult() is true) or wait_end is passed.
+    // Meanwhile the thread runs tasks of its own pool, or of this one, if it's not a worker thread. Returns false on the timeout
+    bool WaitForTask(const TaskHandleBase& task_handle, std::chrono::steady_clock::time_point wait_end = std::chrono::steady_clock::time_point::max());
 
+    // Tasks added from a worker thread go to the local deque of the worker, other tasks go to the shared queue
     void AddTask(std::unique_ptr<TaskBase> task, TaskPriority priority);
 
-    bool AddFreeWorker(TaskWorker* worker);
+    void AddMainThreadTask(std::unique_ptr<TaskBase> task);
+
+    // Puts the task to the back of the shared queue, even on a worker thread, so it's run after the tasks which already wait
+    void RequeueTask(std::unique_ptr<TaskBase> task, TaskPriority priority);
+
+    // Pushes the worker to the free workers stack, if it's not there yet
+    void AddFreeWorker(TaskWorker* worker);
 
+    // Pops a worker from the free workers stack, nullptr if there is no free workers
+    TaskWorker* PopFreeWorker();
+
+    // Looks for a task in the local deque of the current worker, then in the shared queue, then in other workers deques.
+    // Tasks close to their deadline go first, then priorities which waited for too long, then the rest from higher priorities to lower
     std::optional<std::unique_ptr<TaskBase>> GetNextTask();
 
+    // Runs the task and charges the background budget for it
+    void ExecuteTask(TaskBase& task);
+
 private:
+    // Queue for the tasks added from non-worker threads
     struct TasksContainer
     {
         TasksContainer();
 
-        TaskPriority priority;
+        // All should be called under the lock. Pop returns the task with the earliest deadline, if there is one
+        void Push(std::unique_ptr<TaskBase> task);
+        void PushWithDeadline(std::unique_ptr<TaskBase> task);
+        std::unique_ptr<TaskBase> Pop();
+        std::unique_ptr<TaskBase> PopEarliestDeadline();
+
+        bool IsEmpty() const;
+
         SpinLock lock;
+        TaskPriority priority;
+        // Ring buffer, which is reallocated only when it's full
         std::vector<std::unique_ptr<TaskBase>> tasks;
+        size_t first_task = 0;
+        // Allows to skip empty containers without taking the lock
+        std::atomic_size_t tasks_count = 0;
+
+        // Min-heap of the tasks with a deadline
+        std::vector<std::unique_ptr<TaskBase>> deadline_tasks;
+        std::atomic_size_t deadline_tasks_count = 0;
+        // Deadline on the top of the heap in clock ticks, allows to check for urgent tasks without taking the lock
+        std::atomic<std::chrono::steady_clock::rep> earliest_deadline = std::chrono::steady_clock::time_point::max().time_since_epoch().count();
+
+        // Last time a task of this priority was taken, in clock ticks. Used to find starving priorities
+        std::atomic<std::chrono::steady_clock::rep> last_served_time = 0;
     };
 
     TasksContainer& GetTasksForPriority(TaskPriority priority);
 
-    static unsigned int CalcMaxWorkersCount();
+    std::unique_ptr<TaskBase> PopWaitingTask(TasksContainer& tasks);
+
+    // Takes a task of the priority from the local deque, the shared queue or other workers
+    std::unique_ptr<TaskBase> GetTaskForPriority(TasksContainer& tasks, TaskWorker* current_worker, std::chrono::steady_clock::time_point now);
+
+    // Takes a task, which deadline is closer than kUrgentDeadlineSlack
+    std::unique_ptr<TaskBase> PopUrgentTask(std::chrono::steady_clock::time_point now);
+
+    bool IsBackgroundBudgetExhausted() const;
+
+    std::unique_ptr<TaskBase> StealTask(TaskPriority priority, const TaskWorker* thief);
+
+    // Worker of this manager running on the current thread, nullptr if there is no one
+    TaskWorker* GetCurrentWorker() const;
+
+    // Wakes up a free worker or starts a new one, so it could pick up a task which was just added
+    void NotifyWorker();
+
+    void StartNewWorker(std::unique_ptr<TaskBase> first_task);
+
+    // Starts a thread for a worker, which was started before, but has retired since
+    void RestartWorker(TaskWorker* worker);
+
+    void StartWorkerThread(TaskWorker* worker, std::unique_ptr<TaskBase> first_task);
+
+    // Lets the idle worker thread exit, if there are more running workers than the minimum
+    bool RetireWorker(TaskWorker* worker);
+
+    static unsigned int CalcMaxWorkersCount(const Config& config);
 
     std::array<TasksContainer, AllTaskPriorities.size()> waiting_tasks;
 
-    // TODO: Can use a lock-free container, probably?
+    // Guards starting of new workers
     SpinLock workers_lock;
+    // All workers are created beforehand, so the list is never reallocated and could be read without the lock
     std::vector<std::unique_ptr<TaskWorker>> workers;
-    std::vector<TaskWorker*> free_workers;
+    std::atomic_uint started_workers_count = 0;
+    std::atomic_uint running_workers_count = 0;
+    // Worker threads which haven't exited yet, including the retired ones
+    std::atomic_uint alive_threads_count = 0;
+
+    // Lock-free stack of parked workers. Low 32 bits store top worker index + 1, high 32 bits store a counter against ABA
+    std::atomic_uint64_t free_workers_head = 0;
 
+    // Zero means no limit
+    std::atomic<std::chrono::nanoseconds::rep> background_budget_ns = 0;
+    // Time spent on background tasks since the last BeginFrame
+    std::atomic<std::chrono::nanoseconds::rep> frame_background_time_ns = 0;
+
+    const std::string name;
+    const Config config;
     unsigned int maxWorkersCount = 0;
 
-};
\ No newline at end of file
+};
+
+template<class ResultType>
+ResultType TaskHandle<ResultType>::WaitForTaskResult()
+{
+    if (!HasTaskResult())
+        manager.WaitForTask(*this);
+
+    ThrowIfFailed();
+    return task_result;
+}
+
+template<class ResultType>
+std::optional<ResultType> TaskHandle<ResultType>::WaitForTaskResult(std::chrono::steady_clock::duration timeout)
+{
+    if (!HasTaskResult() && !manager.WaitForTask(*this, std::chrono::steady_clock::now() + timeout))
+        return std::nullopt;
+
+    ThrowIfFailed();
+    return task_result;
+}
+
+inline void TaskHandle<void>::WaitForTaskResult()
+{
+    if (!HasTaskResult())
+        manager.WaitForTask(*this);
+
+    ThrowIfFailed();
+}
+
+inline bool TaskHandle<void>::WaitForTaskResult(std::chrono::steady_clock::duration timeout)
+{
+    if (!HasTaskResult() && !manager.WaitForTask(*this, std::chrono::steady_clock::now() + timeout))
+        return false;
+
+    ThrowIfFailed();
+    return true;
+}
+
+template<class ResultType>
+template<class Function>
+auto TaskHandle<ResultType>::Then(TaskPriority priority, Function&& func)
+{
+    auto self = std::static_pointer_cast<TaskHandle<ResultType>>(shared_from_this());
+    return manager.RunTaskAfter(self, priority, [self, func = std::forward<Function>(func)]() mutable
+    {
+        return func(self->GetTaskResult());
+    });
+}
+
+template<class Function>
+auto TaskHandle<void>::Then(TaskPriority priority, Function&& func)
+{
+    auto self = std::static_pointer_cast<TaskHandle<void>>(shared_from_this());
+    return manager.RunTaskAfter(self, priority, [self, func = std::forward<Function>(func)]() mutable
+    {
+        self->ThrowIfFailed();
+        return func();
+    });
+}
+
+template<class Function>
+void SlicedTask<Function>::RunTask()
+{
+    TaskProfiler::ScopedTaskRun profile_scope(*this);
+
+    auto shared_handle = task_handle.lock();
+    if (shared_handle)
+        shared_handle->AddSlice();
+
+    TaskSlice slice(TaskSlice::Clock::now() + slice_budget, shared_handle.get());
+    bool is_done = false;
+    try
+    {
+        is_done = function_to_run(slice);
+    }
+    catch (...)
+    {
+        shared_handle.reset();
+        FailTask(task_handle, std::current_exception());
+        return;
+    }
+
+    if (is_done)
+    {
+        if (shared_handle)
+        {
+            shared_handle->SetProgress(1.f);
+            shared_handle->MarkFinished();
+        }
+        return;
+    }
+
+    // This task is destroyed by the caller, so the rest of the work moves to a new one
+    std::unique_ptr<TaskBase> next_slice(new SlicedTask<Function>(manager, std::move(function_to_run), std::move(task_handle), slice_budget, is_main_thread));
+    next_slice->deadline = deadline;
+    if (is_main_thread)
+        manager.AddMainThreadTask(std::move(next_slice));
+    else
+        manager.RequeueTask(std::move(next_slice), priority);
+}
\ No newline at end of file
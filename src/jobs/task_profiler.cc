@@ -0,0 +1,264 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_profiler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "task_worker.h"
+#include "locks/scoped_lock.h"
+#include "locks/hybrid_mutex.h"
+#include "log.h"
+
+std::atomic_bool TaskProfiler::is_enabled = false;
+
+namespace
+{
+    // Records of one thread. Only the owner thread writes to it, records below count are never changed until the next capture
+    struct ThreadBuffer
+    {
+        explicit ThreadBuffer(std::string name)
+        : records(new TaskProfiler::TaskRecord[TaskProfiler::kMaxRecordsPerThread]), thread_name(std::move(name))
+        {}
+
+        std::unique_ptr<TaskProfiler::TaskRecord[]> records;
+        std::atomic_size_t count = 0;
+        // Capture the records belong to. The owner thread drops old records, when it sees a new capture
+        std::atomic_uint32_t capture = 0;
+        std::atomic_uint64_t dropped_count = 0;
+        // Buffer of a finished thread is given to the next new thread
+        std::atomic_bool is_owned = true;
+        std::string thread_name;
+    };
+
+    struct BuffersRegistry
+    {
+        BuffersRegistry()
+        : lock("TaskProfilerLock")
+        {}
+
+        // Export holds it for the whole trace, so the threads registering their buffers meanwhile sleep instead of spinning
+        HybridMutex lock;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::atomic_uint32_t current_capture = 0;
+        TaskProfiler::Clock::time_point capture_start;
+    };
+
+    BuffersRegistry& GetRegistry()
+    {
+        // Never destroyed, since detached worker threads may record tasks at the very end of the program
+        static auto* registry = new BuffersRegistry();
+        return *registry;
+    }
+
+    // Releases the buffer, when the thread is finished
+    struct ThreadBufferOwner
+    {
+        ~ThreadBufferOwner()
+        {
+            if(buffer)
+                buffer->is_owned.store(false, std::memory_order_release);
+        }
+
+        ThreadBuffer* buffer = nullptr;
+    };
+
+    thread_local ThreadBufferOwner current_buffer;
+
+    ThreadBuffer& GetThreadBuffer()
+    {
+        if(current_buffer.buffer)
+            return *current_buffer.buffer;
+
+        auto* worker = TaskWorker::GetCurrent();
+        std::string name = worker ? worker->GetName() : "Thread";
+
+        auto& registry = GetRegistry();
+        ScopedLock scopeRegistryLock(registry.lock);
+        // Records of the current capture are still exported under the name of the finished thread, so its buffer waits for the next one
+        const uint32_t capture = registry.current_capture.load(std::memory_order_relaxed);
+        for(auto& buffer : registry.buffers)
+        {
+            bool is_owned = false;
+            if(!buffer->is_owned.load(std::memory_order_relaxed) && buffer->capture.load(std::memory_order_acquire) != capture
+                && buffer->is_owned.compare_exchange_strong(is_owned, true, std::memory_order_acquire))
+            {
+                buffer->thread_name = std::move(name);
+                current_buffer.buffer = buffer.get();
+                return *buffer;
+            }
+        }
+
+        registry.buffers.emplace_back(new ThreadBuffer(std::move(name)));
+        current_buffer.buffer = registry.buffers.back().get();
+        return *current_buffer.buffer;
+    }
+
+    // Writes the text as a JSON string literal
+    void WriteJsonString(std::ostream& stream, std::string_view text)
+    {
+        stream << '"';
+        for(const char c : text)
+        {
+            if(c == '"' || c == '\\')
+                stream << '\\' << c;
+            else if(static_cast<unsigned char>(c) < 0x20)
+            {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+                stream << buffer;
+            }
+            else
+                stream << c;
+        }
+        stream << '"';
+    }
+
+    double ToMicroseconds(TaskProfiler::Clock::time_point time, TaskProfiler::Clock::time_point origin)
+    {
+        return std::chrono::duration<double, std::micro>(time - origin).count();
+    }
+}
+
+void TaskProfiler::Start()
+{
+    auto& registry = GetRegistry();
+    {
+        ScopedLock scopeRegistryLock(registry.lock);
+        registry.capture_start = Clock::now();
+        registry.current_capture.fetch_add(1, std::memory_order_release);
+    }
+    is_enabled.store(true, std::memory_order_relaxed);
+}
+
+void TaskProfiler::Stop()
+{
+    is_enabled.store(false, std::memory_order_relaxed);
+}
+
+void TaskProfiler::RecordTask(const TaskRecord& record)
+{
+    auto& buffer = GetThreadBuffer();
+
+    const uint32_t capture = GetRegistry().current_capture.load(std::memory_order_acquire);
+    if(buffer.capture.load(std::memory_order_relaxed) != capture)
+    {
+        // Count is reset before the capture is published, so readers never see records of the previous capture
+        buffer.count.store(0, std::memory_order_relaxed);
+        buffer.dropped_count.store(0, std::memory_order_relaxed);
+        buffer.capture.store(capture, std::memory_order_release);
+    }
+
+    const size_t count = buffer.count.load(std::memory_order_relaxed);
+    if(count == kMaxRecordsPerThread)
+    {
+        buffer.dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto* worker = TaskWorker::GetCurrent();
+    buffer.records[count] = record;
+    buffer.records[count].worker_index = worker ? static_cast<int>(worker->GetIndex()) : -1;
+    buffer.count.store(count + 1, std::memory_order_release);
+}
+
+uint64_t TaskProfiler::GetDroppedRecordsCount()
+{
+    auto& registry = GetRegistry();
+    ScopedLock scopeRegistryLock(registry.lock);
+
+    const uint32_t capture = registry.current_capture.load(std::memory_order_relaxed);
+    uint64_t result = 0;
+    for(auto& buffer : registry.buffers)
+    {
+        if(buffer->capture.load(std::memory_order_acquire) == capture)
+            result += buffer->dropped_count.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void TaskProfiler::ExportChromeTrace(std::ostream& stream)
+{
+    auto& registry = GetRegistry();
+    ScopedLock scopeRegistryLock(registry.lock);
+
+    const uint32_t capture = registry.current_capture.load(std::memory_order_relaxed);
+    const auto origin = registry.capture_start;
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool is_first_event = true;
+    uint64_t queue_event_id = 0;
+    auto begin_event = [&stream, &is_first_event]
+    {
+        stream << (is_first_event ? "\n" : ",\n");
+        is_first_event = false;
+    };
+
+    for(size_t thread_id = 0; thread_id < registry.buffers.size(); ++thread_id)
+    {
+        auto& buffer = *registry.buffers[thread_id];
+        if(buffer.capture.load(std::memory_order_acquire) != capture)
+            continue;
+
+        begin_event();
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread_id
+               << ",\"args\":{\"name\":";
+        WriteJsonString(stream, buffer.thread_name);
+        stream << "}}";
+
+        const size_t count = buffer.count.load(std::memory_order_acquire);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const auto& record = buffer.records[i];
+            const char* priority_name = GetPriorityName(record.priority);
+
+            begin_event();
+            stream << "{\"name\":\"" << priority_name << "\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread_id
+                   << ",\"ts\":" << ToMicroseconds(record.start_time, origin)
+                   << ",\"dur\":" << ToMicroseconds(record.end_time, record.start_time)
+                   << ",\"args\":{\"worker\":" << record.worker_index
+                   << ",\"queued_us\":" << ToMicroseconds(record.start_time, record.enqueue_time) << "}}";
+
+            if(record.enqueue_time == record.start_time)
+                continue;
+
+            // Time in the queue goes to a separate async track, so it's easy to tell queueing delay from execution
+            begin_event();
+            stream << "{\"name\":\"" << priority_name << "\",\"cat\":\"queue\",\"ph\":\"b\",\"pid\":0,\"id\":" << queue_event_id
+                   << ",\"ts\":" << ToMicroseconds(record.enqueue_time, origin) << "}";
+            begin_event();
+            stream << "{\"name\":\"" << priority_name << "\",\"cat\":\"queue\",\"ph\":\"e\",\"pid\":0,\"id\":" << queue_event_id
+                   << ",\"ts\":" << ToMicroseconds(record.start_time, origin) << "}";
+            ++queue_event_id;
+        }
+    }
+
+    stream << "\n]}\n";
+}
+
+bool TaskProfiler::SaveChromeTrace(const std::string& file_path)
+{
+    std::ofstream file(file_path);
+    if(!file)
+    {
+        log_err("Can't open %s to save the task trace", file_path.c_str());
+        return false;
+    }
+
+    ExportChromeTrace(file);
+    return static_cast<bool>(file);
+}
\ No newline at end of file
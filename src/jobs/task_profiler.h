@@ -0,0 +1,101 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "task_base.h"
+
+// Records when every task was queued, started and finished, while a capture is running.
+// Each thread writes to its own buffer without locking, the records are exported on demand in the Chrome trace format,
+// which can be opened in chrome://tracing or ui.perfetto.dev
+class TaskProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Count of records kept per thread in one capture, the rest are dropped
+    static constexpr size_t kMaxRecordsPerThread = 1 << 14;
+
+    struct TaskRecord
+    {
+        Clock::time_point enqueue_time;
+        Clock::time_point start_time;
+        Clock::time_point end_time;
+        // Index of the worker which ran the task, -1 for non-worker threads
+        int worker_index = -1;
+        TaskPriority priority = TaskPriority::Normal;
+    };
+
+    // Starts a new capture, records of the previous one are discarded
+    static void Start();
+
+    static void Stop();
+
+    static bool IsEnabled()
+    {
+        return is_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Saves the record to the buffer of the current thread
+    static void RecordTask(const TaskRecord& record);
+
+    // Count of records which didn't fit into the thread buffers during the current capture
+    static uint64_t GetDroppedRecordsCount();
+
+    // Writes records of the current capture as Chrome trace JSON. Could be called while the capture is running
+    static void ExportChromeTrace(std::ostream& stream);
+
+    static bool SaveChromeTrace(const std::string& file_path);
+
+    // Measures execution of a task, if the profiler is enabled
+    class ScopedTaskRun
+    {
+    public:
+        explicit ScopedTaskRun(const TaskBase& running_task)
+        : task(running_task)
+        {
+            if(IsEnabled())
+                start_time = Clock::now();
+        }
+
+        ~ScopedTaskRun()
+        {
+            // Capture could be started while the task was running
+            if(start_time == Clock::time_point() || !IsEnabled())
+                return;
+
+            TaskRecord record;
+            record.enqueue_time = task.enqueue_time == Clock::time_point() ? start_time : task.enqueue_time;
+            record.start_time = start_time;
+            record.end_time = Clock::now();
+            record.priority = task.priority;
+            RecordTask(record);
+        }
+
+        ScopedTaskRun(const ScopedTaskRun&) = delete;
+        ScopedTaskRun& operator=(const ScopedTaskRun&) = delete;
+
+    private:
+        const TaskBase& task;
+        Clock::time_point start_time;
+    };
+
+private:
+    static std::atomic_bool is_enabled;
+};
\ No newline at end of file
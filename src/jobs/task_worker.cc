@@ -14,28 +14,49 @@
 
 #include "task_worker.h"
 
-#include <sstream>
-#include "task_base.h"
+#include <cassert>
+#include <thread>
+#include "epoch_reclaimer.h"
+#include "thread_utils.h"
 #include "log.h"
 
-TaskWorker::TaskWorker()
-: should_work(true), stopped(false)
+static thread_local TaskWorker* current_worker = nullptr;
+
+// Count of attempts to get a wake up permit before falling asleep
+static constexpr unsigned kParkSpinsCount = 64;
+
+TaskWorker::TaskWorker(unsigned worker_index, std::string worker_name, std::chrono::milliseconds idle_timeout, int cpu_core)
+: should_work(true), stopped(false), index(worker_index), name(std::move(worker_name)), max_idle_time(idle_timeout), pinned_core(cpu_core)
 {}
 
+TaskWorker::~TaskWorker()
+{
+    // Tasks left in the local deques are never going to run
+    for(auto& tasks : local_tasks)
+    {
+        while(TaskBase* task = tasks.Pop())
+            delete task;
+    }
+}
+
 void TaskWorker::StartWorker(std::unique_ptr<TaskBase> &&first_task, const TaskWorker::get_task_func& get_next_task,
-                             const TaskWorker::release_func& release_worker)
+                             const TaskWorker::run_task_func& run_task, const TaskWorker::release_func& release_worker,
+                             const TaskWorker::retire_func& retire_worker)
 {
-    log_info("Staring worker thread");
+    log_info("Staring worker thread %s", name.c_str());
+
+    SetCurrentThreadName(name);
+    if(pinned_core >= 0)
+        PinCurrentThreadToCore(static_cast<unsigned>(pinned_core));
+
+    current_worker = this;
 
+    if(first_task)
     {
-        std::stringstream name_stream;
-        name_stream << std::this_thread::get_id();
-        name = std::move(name_stream.str());
+        run_task(*first_task);
+        first_task.reset(); // Deleting task explicitly since there is an endless cycle below and first_task won't be destroyed until the end of the program
     }
 
-    first_task->RunTask();
-    first_task.reset(); // Deleting task explicitly since there is an endless cycle below and first_task won't be destroyed until the end of the program
-
     while (should_work.load(std::memory_order_acquire))
     {
         // Try to get a new task immediately
@@ -44,32 +65,106 @@ void TaskWorker::StartWorker(std::unique_ptr<TaskBase> &&first_task, const TaskW
             if (opt_task)
             {
                 auto task = std::move(opt_task.value());
-                task->RunTask();
+                run_task(*task);
                 continue;
             }
         }
 
-        // Wait for the next task
+        // Announce that the worker is free and look for a task once more.
+        // A task added right before the announcement could be missed by the notifying thread otherwise
+        release_worker(this);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
         {
-            if(!release_worker(this))
+            auto opt_task = get_next_task();
+            if (opt_task)
+            {
+                auto task = std::move(opt_task.value());
+                run_task(*task);
                 continue;
+            }
+        }
 
-            auto task_future = task_promise.get_future();
-            auto task = task_future.get();
-            // Reset promise to be able to reuse it
-            task_promise = std::promise<std::unique_ptr<TaskBase>>();
-            if(task)
-                task->RunTask();
+        if(!Park() && retire_worker(this))
+        {
+            // Another thread may run this worker already, so nothing of the worker can be touched after retiring
+            log_info("Worker thread retired after being idle");
+            current_worker = nullptr;
+            return;
         }
     }
 
+    current_worker = nullptr;
     stopped.store(true, std::memory_order_release);
 }
 
-void TaskWorker::AssignTask(std::unique_ptr<TaskBase>&& task)
+bool TaskWorker::Unpark()
 {
-    std::atomic_thread_fence(std::memory_order_release);
-    task_promise.set_value(std::move(task));
+    const bool was_notified = wake_permit.exchange(true, std::memory_order_seq_cst);
+
+    if(thread_state.load(std::memory_order_seq_cst) == ThreadState::Retired)
+    {
+        // Either this call or the retiring thread itself gets the worker back to work
+        auto expected_state = ThreadState::Retired;
+        return !thread_state.compare_exchange_strong(expected_state, ThreadState::Running, std::memory_order_seq_cst);
+    }
+
+    if(was_notified)
+        return true;
+
+    // Taking the mutex guarantees the worker is either before the permit check or already waiting
+    {
+        std::lock_guard<std::mutex> scopeParkLock(park_mutex);
+    }
+    park_condition.notify_one();
+    return true;
+}
+
+bool TaskWorker::TryRetire()
+{
+    assert(current_worker == this);
+
+    thread_state.store(ThreadState::Retired, std::memory_order_seq_cst);
+    // Unpark which came before the store above didn't see the retirement, so it's up to this thread to answer it
+    if(!wake_permit.load(std::memory_order_seq_cst))
+        return true;
+
+    auto expected_state = ThreadState::Retired;
+    return !thread_state.compare_exchange_strong(expected_state, ThreadState::Running, std::memory_order_seq_cst);
+}
+
+bool TaskWorker::Park()
+{
+    const auto park_start = std::chrono::steady_clock::now();
+    const bool is_woken = ParkUntilWoken();
+
+    const auto parked_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - park_start);
+    idle_time_ns.store(idle_time_ns.load(std::memory_order_relaxed) + parked_time.count(), std::memory_order_relaxed);
+    return is_woken;
+}
+
+bool TaskWorker::ParkUntilWoken()
+{
+    // Most of the time new tasks come shortly, so it's cheaper to spin a bit than to fall asleep
+    for(unsigned i = 0; i < kParkSpinsCount; ++i)
+    {
+        if(wake_permit.exchange(false, std::memory_order_acquire))
+            return true;
+        std::this_thread::yield();
+    }
+
+    // Retired objects of a worker retiring only a few of them would wait for the collect threshold forever
+    EpochReclaimer::Collect();
+
+    auto is_woken = [this] { return wake_permit.exchange(false, std::memory_order_acquire); };
+
+    std::unique_lock<std::mutex> scopeParkLock(park_mutex);
+    if(max_idle_time.count() == 0)
+    {
+        park_condition.wait(scopeParkLock, is_woken);
+        return true;
+    }
+
+    return park_condition.wait_for(scopeParkLock, max_idle_time, is_woken);
 }
 
 void TaskWorker::MarkStopped()
@@ -77,15 +172,79 @@ void TaskWorker::MarkStopped()
     should_work.store(false, std::memory_order_release);
 }
 
-bool TaskWorker::WaitForStop()
+bool TaskWorker::WaitForStop(std::chrono::milliseconds timeout)
 {
-    // TODO: It's better to add a timeout
+    const auto wait_end = std::chrono::steady_clock::now() + timeout;
     while(!stopped.load(std::memory_order_acquire))
+    {
+        if(std::chrono::steady_clock::now() >= wait_end)
+            return false;
         std::this_thread::yield();
+    }
     return true;
 }
 
+void TaskWorker::PushTask(std::unique_ptr<TaskBase> &&task, TaskPriority priority)
+{
+    assert(current_worker == this);
+    GetTasksForPriority(priority).Push(task.release());
+}
+
+std::unique_ptr<TaskBase> TaskWorker::PopTask(TaskPriority priority)
+{
+    assert(current_worker == this);
+    return std::unique_ptr<TaskBase>(GetTasksForPriority(priority).Pop());
+}
+
+std::unique_ptr<TaskBase> TaskWorker::StealTask(TaskPriority priority)
+{
+    std::unique_ptr<TaskBase> task(GetTasksForPriority(priority).Steal());
+    if(task)
+        stolen_tasks_count.fetch_add(1, std::memory_order_relaxed);
+    return task;
+}
+
+bool TaskWorker::HasTasks(TaskPriority priority) const
+{
+    return !GetTasksForPriority(priority).IsEmpty();
+}
+
+size_t TaskWorker::GetTasksCount(TaskPriority priority) const
+{
+    return GetTasksForPriority(priority).Size();
+}
+
+uint64_t TaskWorker::GetStolenTasksCount() const
+{
+    return stolen_tasks_count.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds TaskWorker::GetIdleTime() const
+{
+    return std::chrono::nanoseconds(idle_time_ns.load(std::memory_order_relaxed));
+}
+
+TaskWorker* TaskWorker::GetCurrent()
+{
+    return current_worker;
+}
+
+unsigned TaskWorker::GetIndex() const
+{
+    return index;
+}
+
 const std::string &TaskWorker::GetName() const
 {
     return name;
+}
+
+WorkStealingQueue<TaskBase>& TaskWorker::GetTasksForPriority(TaskPriority priority)
+{
+    return local_tasks[GetPriorityIndex(priority)];
+}
+
+const WorkStealingQueue<TaskBase>& TaskWorker::GetTasksForPriority(TaskPriority priority) const
+{
+    return local_tasks[GetPriorityIndex(priority)];
 }
\ No newline at end of file
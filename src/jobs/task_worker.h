@@ -14,39 +14,111 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
-#include <future>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
-
-class TaskBase;
+#include "task_base.h"
+#include "work_stealing_queue.h"
 
 class TaskWorker
 {
 public:
-    TaskWorker();
+    // Worker is pinned to cpu_core, if it's not negative. Zero idle_timeout means the worker never retires
+    TaskWorker(unsigned worker_index, std::string worker_name, std::chrono::milliseconds idle_timeout, int cpu_core);
+    ~TaskWorker();
 
     using get_task_func = std::function<std::optional<std::unique_ptr<TaskBase>>()>;
-    using release_func = std::function<bool(TaskWorker *)>;
+    using run_task_func = std::function<void(TaskBase &)>;
+    using release_func = std::function<void(TaskWorker *)>;
+    // Returns true, if the worker thread has retired and may exit
+    using retire_func = std::function<bool(TaskWorker *)>;
 
     void StartWorker(std::unique_ptr<TaskBase> &&first_task, const get_task_func &get_next_task,
-                                  const release_func &release_worker);
+                                  const run_task_func &run_task, const release_func &release_worker,
+                                  const retire_func &retire_worker);
+
+    // Wakes up the worker, if it's parked, or makes its next Park call return immediately.
+    // Returns false, if the worker thread has retired. The caller has to start a new thread for the worker then
+    bool Unpark();
 
-    void AssignTask(std::unique_ptr<TaskBase> &&task);
+    // Marks the thread as retired, if nobody has called Unpark in the meantime. Must be called from the worker thread only
+    bool TryRetire();
 
     void MarkStopped();
 
-    bool WaitForStop();
+    // Returns false, if the worker is still running a task after the timeout
+    bool WaitForStop(std::chrono::milliseconds timeout);
+
+    // Puts a task to the local deque of the worker. Must be called from the worker thread only
+    void PushTask(std::unique_ptr<TaskBase> &&task, TaskPriority priority);
+
+    // Takes the most recently pushed task from the local deque. Must be called from the worker thread only
+    std::unique_ptr<TaskBase> PopTask(TaskPriority priority);
+
+    // Takes the oldest task from the local deque. Can be called from any thread
+    std::unique_ptr<TaskBase> StealTask(TaskPriority priority);
+
+    bool HasTasks(TaskPriority priority) const;
+
+    // Approximate count of tasks in the local deque
+    size_t GetTasksCount(TaskPriority priority) const;
+
+    // Count of tasks other threads took from the local deques
+    uint64_t GetStolenTasksCount() const;
+
+    // Total time the worker spent parked
+    std::chrono::nanoseconds GetIdleTime() const;
+
+    // Worker running on the current thread, nullptr if the thread isn't a worker thread
+    static TaskWorker* GetCurrent();
+
+    unsigned GetIndex() const;
+
+    // Link to the next worker in the free workers stack of the TaskManager, stored as index + 1 (0 is the end of the stack)
+    std::atomic_uint next_free_worker = 0;
+    // Is the worker in the free workers stack
+    std::atomic_bool is_free = false;
 
     const std::string& GetName() const;
 
 private:
-    std::promise<std::unique_ptr<TaskBase>> task_promise;
+    // Waits for Unpark and adds the waiting time to the idle time. Returns false, if the idle timeout has passed
+    bool Park();
+
+    // Spins for a while, then sleeps until Unpark is called or the idle timeout has passed
+    bool ParkUntilWoken();
+
+    WorkStealingQueue<TaskBase>& GetTasksForPriority(TaskPriority priority);
+    const WorkStealingQueue<TaskBase>& GetTasksForPriority(TaskPriority priority) const;
+
+    enum class ThreadState
+    {
+        Running,
+        Retired
+    };
+
+    std::atomic_bool wake_permit = false;
+    std::atomic<ThreadState> thread_state = ThreadState::Running;
+    std::mutex park_mutex;
+    std::condition_variable park_condition;
+
+    std::array<WorkStealingQueue<TaskBase>, AllTaskPriorities.size()> local_tasks;
+
+    std::atomic_uint64_t stolen_tasks_count = 0;
+    // Written by the worker thread only
+    std::atomic_int64_t idle_time_ns = 0;
 
     std::atomic_bool should_work;
     std::atomic_bool stopped;
 
-    std::string name;
+    const unsigned index;
+    const std::string name;
+    const std::chrono::milliseconds max_idle_time;
+    const int pinned_core;
 };
\ No newline at end of file
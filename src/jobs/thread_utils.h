@@ -0,0 +1,24 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+// Sets the name of the current thread shown by debuggers and profilers. Long names are truncated.
+// Does nothing on platforms without the support
+void SetCurrentThreadName(const std::string& name);
+
+// Restricts the current thread to a single CPU core. Returns false, if it's not supported or failed
+bool PinCurrentThreadToCore(unsigned core);
\ No newline at end of file
@@ -0,0 +1,188 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "epoch_reclaimer.h"
+
+// Chase-Lev work-stealing deque (see "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al.)
+// Push and Pop may only be called by the owner thread, they work with the bottom of the deque in LIFO order.
+// Steal may be called by any thread, it takes items from the top of the deque in FIFO order.
+template<class ItemType>
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(size_t initial_capacity = 256);
+    ~WorkStealingQueue();
+
+    WorkStealingQueue(const WorkStealingQueue<ItemType>&) = delete;
+    WorkStealingQueue<ItemType>& operator=(const WorkStealingQueue<ItemType>&) = delete;
+
+    // Puts an item to the bottom of the deque. Owner thread only
+    void Push(ItemType* item);
+
+    // Takes an item from the bottom of the deque, returns nullptr if the deque is empty. Owner thread only
+    ItemType* Pop();
+
+    // Takes an item from the top of the deque, returns nullptr if the deque is empty or the race was lost
+    ItemType* Steal();
+
+    bool IsEmpty() const;
+
+    // Approximate count of items, may be outdated by the moment it's returned
+    size_t Size() const;
+
+private:
+    class Buffer
+    {
+    public:
+        explicit Buffer(size_t buffer_capacity)
+        : capacity(buffer_capacity), mask(buffer_capacity - 1), items(new std::atomic<ItemType*>[buffer_capacity])
+        {}
+
+        ItemType* Get(int64_t index) const
+        {
+            return items[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t index, ItemType* item)
+        {
+            items[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        Buffer* Grow(int64_t top, int64_t bottom) const
+        {
+            auto* result = new Buffer(capacity * 2);
+            for(int64_t i = top; i < bottom; ++i)
+                result->Put(i, Get(i));
+            return result;
+        }
+
+        const size_t capacity;
+
+    private:
+        const size_t mask;
+        std::unique_ptr<std::atomic<ItemType*>[]> items;
+    };
+
+    static constexpr size_t kCacheLineSize = 64;
+
+    alignas(kCacheLineSize) std::atomic<int64_t> top;
+    alignas(kCacheLineSize) std::atomic<int64_t> bottom;
+    alignas(kCacheLineSize) std::atomic<Buffer*> buffer;
+};
+
+template<class ItemType>
+WorkStealingQueue<ItemType>::WorkStealingQueue(size_t initial_capacity)
+: top(0), bottom(0)
+{
+    // Capacity has to be a power of two to use a mask instead of a modulo
+    size_t capacity = 1;
+    while(capacity < initial_capacity)
+        capacity <<= 1;
+
+    buffer.store(new Buffer(capacity), std::memory_order_relaxed);
+}
+
+template<class ItemType>
+WorkStealingQueue<ItemType>::~WorkStealingQueue()
+{
+    delete buffer.load(std::memory_order_relaxed);
+}
+
+template<class ItemType>
+void WorkStealingQueue<ItemType>::Push(ItemType* item)
+{
+    const int64_t current_bottom = bottom.load(std::memory_order_relaxed);
+    const int64_t current_top = top.load(std::memory_order_acquire);
+    Buffer* current_buffer = buffer.load(std::memory_order_relaxed);
+
+    if(current_bottom - current_top > static_cast<int64_t>(current_buffer->capacity) - 1)
+    {
+        Buffer* old_buffer = current_buffer;
+        current_buffer = current_buffer->Grow(current_top, current_bottom);
+        buffer.store(current_buffer, std::memory_order_release);
+        // Stealers may still read from the replaced buffer
+        EpochReclaimer::Retire(old_buffer);
+    }
+
+    current_buffer->Put(current_bottom, item);
+    bottom.store(current_bottom + 1, std::memory_order_release);
+}
+
+template<class ItemType>
+ItemType* WorkStealingQueue<ItemType>::Pop()
+{
+    const int64_t current_bottom = bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* current_buffer = buffer.load(std::memory_order_relaxed);
+    bottom.store(current_bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t current_top = top.load(std::memory_order_relaxed);
+
+    if(current_top > current_bottom)
+    {
+        // Deque is empty
+        bottom.store(current_bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    ItemType* item = current_buffer->Get(current_bottom);
+    if(current_top == current_bottom)
+    {
+        // The last item, race against stealers for it
+        if(!top.compare_exchange_strong(current_top, current_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            item = nullptr;
+        bottom.store(current_bottom + 1, std::memory_order_relaxed);
+    }
+
+    return item;
+}
+
+template<class ItemType>
+ItemType* WorkStealingQueue<ItemType>::Steal()
+{
+    int64_t current_top = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t current_bottom = bottom.load(std::memory_order_acquire);
+
+    if(current_top >= current_bottom)
+        return nullptr;
+
+    // Keeps the buffer alive, if the owner grows the deque meanwhile
+    EpochReclaimer::EpochGuard epoch_guard;
+    Buffer* current_buffer = buffer.load(std::memory_order_consume);
+    ItemType* item = current_buffer->Get(current_top);
+    if(!top.compare_exchange_strong(current_top, current_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return item;
+}
+
+template<class ItemType>
+bool WorkStealingQueue<ItemType>::IsEmpty() const
+{
+    return Size() == 0;
+}
+
+template<class ItemType>
+size_t WorkStealingQueue<ItemType>::Size() const
+{
+    const int64_t current_bottom = bottom.load(std::memory_order_relaxed);
+    const int64_t current_top = top.load(std::memory_order_relaxed);
+    return current_bottom > current_top ? static_cast<size_t>(current_bottom - current_top) : 0;
+}
\ No newline at end of file
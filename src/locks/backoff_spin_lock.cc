@@ -0,0 +1,38 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "backoff_spin_lock.h"
+
+#include <algorithm>
+#include "spin_backoff.h"
+
+void BackoffSpinLock::AcquireContended()
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    SpinBackoff backoff;
+    do
+    {
+        // Exchange is tried only when the lock looks free, until then the line is only read
+        while(is_locked.load(std::memory_order_relaxed))
+        {
+            backoff.Pause();
+            ++spins_count;
+        }
+    }
+    while(is_locked.exchange(true, std::memory_order_acquire));
+
+    RecordAcquired(std::max<uint64_t>(spins_count, 1), is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_base.h"
+
+#include <atomic>
+
+// Test-and-test-and-set spin lock with exponential backoff. Waiters spin on a plain load, which stays in their caches,
+// and try the exchange only when the lock looks free. Better than SpinLock for the locks contended by many threads
+class BackoffSpinLock final : public LockBase
+{
+public:
+    explicit BackoffSpinLock(const optional_sting& name = optional_sting());
+
+    bool TryAcquire() override;
+    void Acquire() override;
+    void Release() override;
+
+protected:
+    // Acquisition attempt without recording it
+    bool TryLock();
+    // Slow path of Acquire, after the first attempt failed
+    void AcquireContended();
+
+    std::atomic_bool is_locked = false;
+
+    static_assert(std::atomic_bool::is_always_lock_free, "atomic bool is not lock free, need to use other type");
+};
+
+inline BackoffSpinLock::BackoffSpinLock(const optional_sting& name)
+: LockBase(name)
+{
+    lock_class_name = "BackoffSpinLock";
+}
+
+inline bool BackoffSpinLock::TryLock()
+{
+    return !is_locked.load(std::memory_order_relaxed) && !is_locked.exchange(true, std::memory_order_acquire);
+}
+
+inline bool BackoffSpinLock::TryAcquire()
+{
+    if(!TryLock())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordAcquired();
+    return true;
+}
+
+inline void BackoffSpinLock::Release()
+{
+    RecordReleased();
+    is_locked.store(false, std::memory_order_release);
+}
+
+inline void BackoffSpinLock::Acquire()
+{
+    if(TryLock())
+    {
+        RecordAcquired();
+        return;
+    }
+
+    AcquireContended();
+}
\ No newline at end of file
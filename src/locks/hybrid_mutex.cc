@@ -0,0 +1,80 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hybrid_mutex.h"
+
+#include "spin_backoff.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Sleeps, while the word is equal to the expected value. May wake up spuriously
+    void WaitOnAddress(std::atomic_uint32_t& word, uint32_t expected_value)
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected_value, nullptr, nullptr, 0);
+#else
+        word.wait(expected_value, std::memory_order_relaxed);
+#endif
+    }
+
+    void WakeOne(std::atomic_uint32_t& word)
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        word.notify_one();
+#endif
+    }
+}
+
+void HybridMutex::AcquireContended()
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+
+    // Short critical sections are usually over before the backoff is
+    SpinBackoff backoff;
+    for(; spins_count < kMaxSpinsCount; ++spins_count)
+    {
+        backoff.Pause();
+        if(state.load(std::memory_order_relaxed) == Unlocked && TryLock())
+        {
+            RecordAcquired(spins_count + 1, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+            return;
+        }
+    }
+
+    // From now on the lock is taken as LockedWithSleepers, since other threads may still sleep, when this one gets it
+    uint32_t previous_state = state.exchange(LockedWithSleepers, std::memory_order_acquire);
+    while(previous_state != Unlocked)
+    {
+        WaitOnAddress(state, LockedWithSleepers);
+        ++spins_count;
+        previous_state = state.exchange(LockedWithSleepers, std::memory_order_acquire);
+    }
+
+    RecordAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
+
+void HybridMutex::WakeSleeper()
+{
+    WakeOne(state);
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_base.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Lock for the critical sections, which may be long. Spins for a short while like a spin lock, then puts the thread to sleep
+// on a futex, so waiters don't burn cores when the owner is slow or preempted. Release makes a syscall only when somebody sleeps
+class HybridMutex final : public LockBase
+{
+public:
+    // Count of backoff rounds before going to sleep
+    static constexpr uint32_t kMaxSpinsCount = 10;
+
+    explicit HybridMutex(const optional_sting& name = optional_sting());
+
+    bool TryAcquire() override;
+    void Acquire() override;
+    void Release() override;
+
+protected:
+    enum State : uint32_t
+    {
+        Unlocked = 0,
+        Locked = 1,
+        // Locked, and some of the waiters may sleep
+        LockedWithSleepers = 2
+    };
+
+    // Acquisition attempt without recording it
+    bool TryLock();
+    // Slow path of Acquire, after the first attempt failed
+    void AcquireContended();
+    // Slow path of Release, when somebody may sleep on the lock
+    void WakeSleeper();
+
+    std::atomic_uint32_t state = Unlocked;
+
+    static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+};
+
+inline HybridMutex::HybridMutex(const optional_sting& name)
+: LockBase(name)
+{
+    lock_class_name = "HybridMutex";
+}
+
+inline bool HybridMutex::TryLock()
+{
+    uint32_t expected_state = Unlocked;
+    return state.compare_exchange_strong(expected_state, Locked, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+inline bool HybridMutex::TryAcquire()
+{
+    if(!TryLock())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordAcquired();
+    return true;
+}
+
+inline void HybridMutex::Acquire()
+{
+    if(TryLock())
+    {
+        RecordAcquired();
+        return;
+    }
+
+    AcquireContended();
+}
+
+inline void HybridMutex::Release()
+{
+    RecordReleased();
+    if(state.exchange(Unlocked, std::memory_order_release) == LockedWithSleepers)
+        WakeSleeper();
+}
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include "lock_stats.h"
 
 class LockBase
 {
@@ -44,8 +45,18 @@ public:
     void UpdateName(std::string&& new_name);
 
 protected:
+    // Updates the LockStats counters, when the collection is enabled. Spins and wait time are for the contended acquisitions
+    void RecordAcquired(uint64_t spins_count = 0, LockStats::Clock::duration wait_time = LockStats::Clock::duration::zero());
+    void RecordTryAcquireFailed();
+    // Should be called by the owner before the lock is actually released
+    void RecordReleased();
+
     std::string lock_class_name;
     std::string lock_name;
+
+    LockStats::Counters* stats_counters;
+    // Written and read only by the owner of the lock, zero when the acquisition wasn't recorded
+    LockStats::Clock::time_point acquired_time;
 };
 
 inline LockBase::LockBase(optional_sting name)
@@ -55,6 +66,7 @@ inline LockBase::LockBase(optional_sting name)
         lock_name = name.value();
     else
         lock_name = "Unnamed";
+    stats_counters = LockStats::GetCounters(lock_name);
 }
 
 template<class StreamClass>
@@ -67,9 +79,44 @@ StreamClass& operator<<(StreamClass& stream, const LockBase& lock)
 inline void LockBase::UpdateName(const std::string &new_name)
 {
     lock_name = new_name;
+    stats_counters = LockStats::GetCounters(lock_name);
 }
 
 inline void LockBase::UpdateName(std::string &&new_name)
 {
     lock_name = std::move(new_name);
+    stats_counters = LockStats::GetCounters(lock_name);
+}
+
+inline void LockBase::RecordAcquired(uint64_t spins_count, LockStats::Clock::duration wait_time)
+{
+    if(!LockStats::IsEnabled())
+        return;
+
+    stats_counters->acquisitions_count.fetch_add(1, std::memory_order_relaxed);
+    if(spins_count > 0)
+    {
+        stats_counters->contended_count.fetch_add(1, std::memory_order_relaxed);
+        stats_counters->spins_count.fetch_add(spins_count, std::memory_order_relaxed);
+        stats_counters->wait_time_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(wait_time).count(), std::memory_order_relaxed);
+    }
+    acquired_time = LockStats::Clock::now();
+}
+
+inline void LockBase::RecordTryAcquireFailed()
+{
+    if(LockStats::IsEnabled())
+        stats_counters->failed_try_acquisitions_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void LockBase::RecordReleased()
+{
+    // Collection could be enabled while the lock was held
+    if(acquired_time == LockStats::Clock::time_point())
+        return;
+
+    const auto hold_time = LockStats::Clock::now() - acquired_time;
+    acquired_time = LockStats::Clock::time_point();
+    if(LockStats::IsEnabled())
+        stats_counters->hold_time_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(hold_time).count(), std::memory_order_relaxed);
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <concepts>
+
+// Requirements of the scoped guards. Guards are templates over the lock type, so calls on a final lock class are resolved
+// at compile time and inlined, while a LockBase reference still goes through the virtual interface
+template<class LockClass>
+concept Lockable = requires(LockClass& lock)
+{
+    { lock.TryAcquire() } -> std::convertible_to<bool>;
+    lock.Acquire();
+    lock.Release();
+};
+
+template<class LockClass>
+concept SharedLockable = Lockable<LockClass> && requires(LockClass& lock)
+{
+    { lock.TryAcquireShared() } -> std::convertible_to<bool>;
+    lock.AcquireShared();
+    lock.ReleaseShared();
+};
\ No newline at end of file
@@ -0,0 +1,127 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lock_stats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+std::atomic_bool LockStats::is_enabled = false;
+
+namespace
+{
+    // Guarded by a standard mutex, since the engine locks use the registry themselves
+    struct CountersRegistry
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<LockStats::Counters>> counters;
+    };
+
+    CountersRegistry& GetRegistry()
+    {
+        // Never destroyed, since static locks may be used at the very end of the program
+        static auto* registry = new CountersRegistry();
+        return *registry;
+    }
+
+    double ToMilliseconds(std::chrono::nanoseconds duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+}
+
+void LockStats::SetEnabled(bool enabled)
+{
+    is_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+LockStats::Counters* LockStats::GetCounters(const std::string& lock_name)
+{
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> registry_lock(registry.mutex);
+
+    auto& counters = registry.counters[lock_name];
+    if(!counters)
+        counters.reset(new Counters());
+    return counters.get();
+}
+
+void LockStats::Reset()
+{
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> registry_lock(registry.mutex);
+
+    for(auto& [name, counters] : registry.counters)
+    {
+        counters->acquisitions_count.store(0, std::memory_order_relaxed);
+        counters->contended_count.store(0, std::memory_order_relaxed);
+        counters->failed_try_acquisitions_count.store(0, std::memory_order_relaxed);
+        counters->spins_count.store(0, std::memory_order_relaxed);
+        counters->wait_time_ns.store(0, std::memory_order_relaxed);
+        counters->hold_time_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<LockStats::Entry> LockStats::GetReport()
+{
+    std::vector<Entry> result;
+    {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> registry_lock(registry.mutex);
+
+        for(auto& [name, counters] : registry.counters)
+        {
+            Entry entry;
+            entry.lock_name = name;
+            entry.acquisitions_count = counters->acquisitions_count.load(std::memory_order_relaxed);
+            entry.contended_count = counters->contended_count.load(std::memory_order_relaxed);
+            entry.failed_try_acquisitions_count = counters->failed_try_acquisitions_count.load(std::memory_order_relaxed);
+            entry.spins_count = counters->spins_count.load(std::memory_order_relaxed);
+            entry.wait_time = std::chrono::nanoseconds(counters->wait_time_ns.load(std::memory_order_relaxed));
+            entry.hold_time = std::chrono::nanoseconds(counters->hold_time_ns.load(std::memory_order_relaxed));
+
+            if(entry.acquisitions_count > 0 || entry.failed_try_acquisitions_count > 0)
+                result.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const Entry& first, const Entry& second)
+    {
+        if(first.wait_time != second.wait_time)
+            return first.wait_time > second.wait_time;
+        return first.contended_count > second.contended_count;
+    });
+    return result;
+}
+
+void LockStats::WriteReport(std::ostream& stream)
+{
+    const auto report = GetReport();
+
+    stream << std::left << std::setw(40) << "Lock" << std::right
+           << std::setw(14) << "Acquired" << std::setw(14) << "Contended" << std::setw(14) << "TryFailed"
+           << std::setw(14) << "Spins" << std::setw(12) << "Wait ms" << std::setw(12) << "Hold ms" << "\n";
+
+    for(const auto& entry : report)
+    {
+        stream << std::left << std::setw(40) << entry.lock_name << std::right
+               << std::setw(14) << entry.acquisitions_count << std::setw(14) << entry.contended_count
+               << std::setw(14) << entry.failed_try_acquisitions_count << std::setw(14) << entry.spins_count
+               << std::setw(12) << std::fixed << std::setprecision(3) << ToMilliseconds(entry.wait_time)
+               << std::setw(12) << ToMilliseconds(entry.hold_time) << "\n";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Contention counters of the locks, collected while enabled. Locks with the same name share the counters,
+// so e.g. the queue locks of all task priorities in a pool are told apart, but the same lock of every object is summed up
+class LockStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Counters
+    {
+        std::atomic_uint64_t acquisitions_count = 0;
+        // Acquisitions which had to wait for another owner
+        std::atomic_uint64_t contended_count = 0;
+        std::atomic_uint64_t failed_try_acquisitions_count = 0;
+        std::atomic_uint64_t spins_count = 0;
+        std::atomic_uint64_t wait_time_ns = 0;
+        std::atomic_uint64_t hold_time_ns = 0;
+    };
+
+    // Snapshot of the counters of one lock name
+    struct Entry
+    {
+        std::string lock_name;
+        uint64_t acquisitions_count = 0;
+        uint64_t contended_count = 0;
+        uint64_t failed_try_acquisitions_count = 0;
+        uint64_t spins_count = 0;
+        std::chrono::nanoseconds wait_time = std::chrono::nanoseconds::zero();
+        std::chrono::nanoseconds hold_time = std::chrono::nanoseconds::zero();
+    };
+
+    // Collection is disabled by default, locks only check the flag then
+    static void SetEnabled(bool enabled);
+
+    static bool IsEnabled()
+    {
+        return is_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Counters of the lock name. They are never freed, so the locks could keep the pointer
+    static Counters* GetCounters(const std::string& lock_name);
+
+    static void Reset();
+
+    // Locks which were acquired since the last reset, the most waited for go first
+    static std::vector<Entry> GetReport();
+
+    // Writes the report as a table
+    static void WriteReport(std::ostream& stream);
+
+private:
+    static std::atomic_bool is_enabled;
+};
\ No newline at end of file
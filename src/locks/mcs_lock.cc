@@ -0,0 +1,48 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mcs_lock.h"
+
+#include <algorithm>
+#include "spin_backoff.h"
+
+void McsLock::WaitInQueue(Node* node, Node* previous)
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+
+    // The previous owner hands the lock over by resetting the flag of this node
+    previous->next.store(node, std::memory_order_release);
+    SpinBackoff backoff;
+    while(node->is_waiting.load(std::memory_order_acquire))
+    {
+        backoff.Pause();
+        ++spins_count;
+    }
+
+    owner_node = node;
+    RecordAcquired(std::max<uint64_t>(spins_count, 1), is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
+
+void McsLock::HandOver(Node* node)
+{
+    // A new waiter may have replaced the tail already, but not linked itself to this node yet
+    Node* successor = nullptr;
+    while(!(successor = node->next.load(std::memory_order_acquire)))
+        CpuRelax();
+
+    successor->is_waiting.store(false, std::memory_order_release);
+    nodes_cache.Return(node);
+}
\ No newline at end of file
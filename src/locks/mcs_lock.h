@@ -0,0 +1,141 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_base.h"
+
+#include <atomic>
+#include <vector>
+
+// Queue lock by Mellor-Crummey and Scott. Every waiter spins on a flag in its own queue node, so a release touches
+// only the cache of the next owner. Fair like the TicketLock, and scales better with many waiters.
+// Nodes are taken from a cache of the acquiring thread, so the lock must be released by the same thread
+class McsLock final : public LockBase
+{
+public:
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct alignas(kCacheLineSize) Node
+    {
+        std::atomic<Node*> next = nullptr;
+        std::atomic_bool is_waiting = false;
+    };
+
+    explicit McsLock(const optional_sting& name = optional_sting());
+
+    bool TryAcquire() override;
+    void Acquire() override;
+    void Release() override;
+
+protected:
+    // Queue nodes of the thread. A node is taken for every held McsLock, so the thread could hold several of them at once
+    class NodesCache
+    {
+    public:
+        ~NodesCache()
+        {
+            for(auto* node : free_nodes)
+                delete node;
+        }
+
+        Node* Take()
+        {
+            if(free_nodes.empty())
+                return new Node();
+
+            auto* node = free_nodes.back();
+            free_nodes.pop_back();
+            return node;
+        }
+
+        void Return(Node* node)
+        {
+            free_nodes.push_back(node);
+        }
+
+    private:
+        std::vector<Node*> free_nodes;
+    };
+
+    // Slow path of Acquire, when the lock was taken by somebody else
+    void WaitInQueue(Node* node, Node* previous);
+    // Slow path of Release, when a waiter is queued after the owner
+    void HandOver(Node* node);
+
+    static inline thread_local NodesCache nodes_cache;
+
+    // Last node of the waiters queue, nullptr if the lock is free
+    alignas(kCacheLineSize) std::atomic<Node*> tail = nullptr;
+    // Node of the current owner, accessed only by the owner
+    Node* owner_node = nullptr;
+};
+
+inline McsLock::McsLock(const optional_sting& name)
+: LockBase(name)
+{
+    lock_class_name = "McsLock";
+}
+
+inline bool McsLock::TryAcquire()
+{
+    auto* node = nodes_cache.Take();
+    node->next.store(nullptr, std::memory_order_relaxed);
+
+    Node* expected_tail = nullptr;
+    if(!tail.compare_exchange_strong(expected_tail, node, std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        nodes_cache.Return(node);
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    owner_node = node;
+    RecordAcquired();
+    return true;
+}
+
+inline void McsLock::Acquire()
+{
+    auto* node = nodes_cache.Take();
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->is_waiting.store(true, std::memory_order_relaxed);
+
+    Node* previous = tail.exchange(node, std::memory_order_acq_rel);
+    if(!previous)
+    {
+        owner_node = node;
+        RecordAcquired();
+        return;
+    }
+
+    WaitInQueue(node, previous);
+}
+
+inline void McsLock::Release()
+{
+    RecordReleased();
+
+    // The next owner overwrites it, so it's read before the hand over
+    auto* node = owner_node;
+    Node* expected_tail = node;
+    if(!node->next.load(std::memory_order_acquire)
+        && tail.compare_exchange_strong(expected_tail, nullptr, std::memory_order_release, std::memory_order_relaxed))
+    {
+        nodes_cache.Return(node);
+        return;
+    }
+
+    HandOver(node);
+}
\ No newline at end of file
@@ -14,39 +14,17 @@
 
 #include "reentrant_lock.h"
 
-#include <cassert>
-
-bool ReentrantLock::TryAcquire()
-{
-    int expected_count = 0;
-    if(lock_count.compare_exchange_weak(expected_count, 1, std::memory_order_acquire))
-    {
-        assert(owner_thread_id == thread_id());
-        owner_thread_id = std::this_thread::get_id();
-        return true;
-    }
-
-    if(owner_thread_id == std::this_thread::get_id())
-    {
-        assert(lock_count > 0);
-        lock_count.fetch_add(1, std::memory_order_relaxed);
-        return true;
-    }
-
-    return false;
-}
-
-void ReentrantLock::Release()
+void ReentrantLock::AcquireContended()
 {
-    assert(owner_thread_id == std::this_thread::get_id());
-    assert(lock_count > 0);
-
-    if(lock_count > 1)
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    do
     {
-        lock_count.fetch_add(-1, std::memory_order_relaxed);
-        return;
+        std::this_thread::yield();
+        ++spins_count;
     }
+    while(!TryLock());
 
-    owner_thread_id = thread_id();
-    lock_count.store(0, std::memory_order_release);
+    RecordOutermostAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
 }
\ No newline at end of file
@@ -17,9 +17,10 @@
 #include "lock_base.h"
 
 #include <atomic>
+#include <cassert>
 #include <thread>
 
-class ReentrantLock : public LockBase
+class ReentrantLock final : public LockBase
 {
 public:
     explicit ReentrantLock(const optional_sting& name);
@@ -33,7 +34,16 @@ public:
 protected:
     using thread_id = std::thread::id;
 
-    thread_id owner_thread_id = thread_id();
+    // Acquisition attempt without recording it
+    bool TryLock();
+    // Slow path of Acquire, after the first attempt failed
+    void AcquireContended();
+
+    // Only the outermost acquisitions are recorded
+    void RecordOutermostAcquired(uint64_t spins_count = 0, LockStats::Clock::duration wait_time = LockStats::Clock::duration::zero());
+
+    // Read by the other threads in TryLock, only the owner can see its own id there
+    std::atomic<thread_id> owner_thread_id = thread_id();
     std::atomic_int lock_count = 0;
 
     static_assert(std::atomic_int::is_always_lock_free, "atomic int is not lock free, need to use other type");
@@ -45,10 +55,67 @@ inline ReentrantLock::ReentrantLock(const LockBase::optional_sting& name)
     lock_class_name = "ReentrantLock";
 }
 
+inline bool ReentrantLock::TryAcquire()
+{
+    if(!TryLock())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordOutermostAcquired();
+    return true;
+}
+
 inline void ReentrantLock::Acquire()
 {
-    while(!TryAcquire())
+    if(TryLock())
+    {
+        RecordOutermostAcquired();
+        return;
+    }
+
+    AcquireContended();
+}
+
+inline bool ReentrantLock::TryLock()
+{
+    int expected_count = 0;
+    if(lock_count.compare_exchange_weak(expected_count, 1, std::memory_order_acquire))
     {
-        std::this_thread::yield();
+        assert(owner_thread_id.load(std::memory_order_relaxed) == thread_id());
+        owner_thread_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        return true;
     }
+
+    if(owner_thread_id.load(std::memory_order_relaxed) == std::this_thread::get_id())
+    {
+        assert(lock_count > 0);
+        lock_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+inline void ReentrantLock::Release()
+{
+    assert(owner_thread_id.load(std::memory_order_relaxed) == std::this_thread::get_id());
+    assert(lock_count > 0);
+
+    if(lock_count > 1)
+    {
+        lock_count.fetch_add(-1, std::memory_order_relaxed);
+        return;
+    }
+
+    RecordReleased();
+    owner_thread_id.store(thread_id(), std::memory_order_relaxed);
+    lock_count.store(0, std::memory_order_release);
+}
+
+inline void ReentrantLock::RecordOutermostAcquired(uint64_t spins_count, LockStats::Clock::duration wait_time)
+{
+    if(lock_count.load(std::memory_order_relaxed) == 1)
+        RecordAcquired(spins_count, wait_time);
 }
\ No newline at end of file
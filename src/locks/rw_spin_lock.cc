@@ -0,0 +1,52 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rw_spin_lock.h"
+
+#include "spin_backoff.h"
+
+void RWSpinLock::AcquireContended()
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    SpinBackoff backoff;
+    do
+    {
+        // Announces the writer, so no new readers come in while the current ones are draining
+        if((state.load(std::memory_order_relaxed) & kWriterWaitingFlag) == 0)
+            state.fetch_or(kWriterWaitingFlag, std::memory_order_relaxed);
+        backoff.Pause();
+        ++spins_count;
+    }
+    while(!TryLock());
+
+    RecordAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
+
+void RWSpinLock::AcquireSharedContended()
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    SpinBackoff backoff;
+    do
+    {
+        backoff.Pause();
+        ++spins_count;
+    }
+    while(!TryLockShared());
+
+    RecordSharedAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
\ No newline at end of file
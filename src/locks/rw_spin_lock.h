@@ -0,0 +1,153 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_base.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Reader-writer spin lock for read-mostly data, like caches filled once and then looked up by many tasks.
+// Readers take it in parallel with AcquireShared, Acquire takes it exclusively. A waiting writer stops new readers,
+// so a steady stream of lookups can't starve the writer
+class RWSpinLock final : public LockBase
+{
+public:
+    explicit RWSpinLock(const optional_sting& name = optional_sting());
+
+    bool TryAcquire() override;
+    void Acquire() override;
+    void Release() override;
+
+    bool TryAcquireShared();
+    void AcquireShared();
+    void ReleaseShared();
+
+protected:
+    static constexpr uint32_t kWriterLockedFlag = 1u << 31;
+    static constexpr uint32_t kWriterWaitingFlag = 1u << 30;
+    static constexpr uint32_t kReadersMask = kWriterWaitingFlag - 1;
+
+    // Acquisition attempts without recording them
+    bool TryLock();
+    bool TryLockShared();
+    // Slow path of Acquire, after the first attempt failed
+    void AcquireContended();
+    void AcquireSharedContended();
+
+    // Shared owners can't use acquired_time, so only the acquisitions and waits are counted for them
+    void RecordSharedAcquired(uint64_t spins_count = 0, LockStats::Clock::duration wait_time = LockStats::Clock::duration::zero());
+
+    // Writer flags in the high bits, count of readers in the low ones
+    std::atomic_uint32_t state = 0;
+};
+
+inline RWSpinLock::RWSpinLock(const optional_sting& name)
+: LockBase(name)
+{
+    lock_class_name = "RWSpinLock";
+}
+
+inline bool RWSpinLock::TryLock()
+{
+    // Waiting flag may be set by this or another writer, the winner clears it and the others set it again
+    uint32_t current_state = state.load(std::memory_order_relaxed);
+    return (current_state & ~kWriterWaitingFlag) == 0
+        && state.compare_exchange_strong(current_state, kWriterLockedFlag, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+inline bool RWSpinLock::TryLockShared()
+{
+    // Other readers changing the count don't fail the attempt, only a writer does
+    uint32_t current_state = state.load(std::memory_order_relaxed);
+    while((current_state & (kWriterLockedFlag | kWriterWaitingFlag)) == 0)
+    {
+        if(state.compare_exchange_weak(current_state, current_state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+inline bool RWSpinLock::TryAcquire()
+{
+    if(!TryLock())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordAcquired();
+    return true;
+}
+
+inline void RWSpinLock::Release()
+{
+    RecordReleased();
+    // Keeps the waiting flag, which could be set by another writer meanwhile
+    state.fetch_and(~kWriterLockedFlag, std::memory_order_release);
+}
+
+inline bool RWSpinLock::TryAcquireShared()
+{
+    if(!TryLockShared())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordSharedAcquired();
+    return true;
+}
+
+inline void RWSpinLock::ReleaseShared()
+{
+    state.fetch_sub(1, std::memory_order_release);
+}
+
+inline void RWSpinLock::RecordSharedAcquired(uint64_t spins_count, LockStats::Clock::duration wait_time)
+{
+    if(!LockStats::IsEnabled())
+        return;
+
+    stats_counters->acquisitions_count.fetch_add(1, std::memory_order_relaxed);
+    if(spins_count > 0)
+    {
+        stats_counters->contended_count.fetch_add(1, std::memory_order_relaxed);
+        stats_counters->spins_count.fetch_add(spins_count, std::memory_order_relaxed);
+        stats_counters->wait_time_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(wait_time).count(), std::memory_order_relaxed);
+    }
+}
+
+inline void RWSpinLock::Acquire()
+{
+    if(TryLock())
+    {
+        RecordAcquired();
+        return;
+    }
+
+    AcquireContended();
+}
+
+inline void RWSpinLock::AcquireShared()
+{
+    if(TryLockShared())
+    {
+        RecordSharedAcquired();
+        return;
+    }
+
+    AcquireSharedContended();
+}
\ No newline at end of file
@@ -14,7 +14,9 @@
 
 #pragma once
 
-template<class LockClass>
+#include "lock_concepts.h"
+
+template<Lockable LockClass>
 class ScopedLock final
 {
 public:
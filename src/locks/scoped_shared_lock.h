@@ -0,0 +1,46 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_concepts.h"
+
+// ScopedLock counterpart for the shared ownership
+template<SharedLockable LockClass>
+class ScopedSharedLock final
+{
+public:
+    explicit ScopedSharedLock(LockClass& Lock, bool is_lock_already_acquired = false)
+    : LockRef(Lock)
+    {
+        if (!is_lock_already_acquired)
+            LockRef.AcquireShared();
+    }
+
+    ~ScopedSharedLock()
+    {
+        LockRef.ReleaseShared();
+    }
+
+    // Copying ScopedSharedLock is not allowed _for now_ to avoid mistakes
+    ScopedSharedLock(const ScopedSharedLock<LockClass>& other) = delete;
+    ScopedSharedLock<LockClass>& operator=(const ScopedSharedLock<LockClass>& other) = delete;
+
+    // Moving ScopedSharedLock is not allowed _for now_ to avoid mistakes
+    ScopedSharedLock(ScopedSharedLock<LockClass>&& other) = delete;
+    ScopedSharedLock<LockClass>& operator=(ScopedSharedLock<LockClass>&& other) = delete;
+
+private:
+    LockClass& LockRef;
+};
\ No newline at end of file
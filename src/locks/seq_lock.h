@@ -0,0 +1,136 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "spin_backoff.h"
+
+// Sequence lock for the snapshots written by one thread and read by many, like camera matrices or the light list of a frame.
+// Writer never waits for the readers: it makes the sequence odd, copies the value and makes it even again.
+// Readers copy the value and retry, if the sequence changed meanwhile, so they could spin while the writer is storing.
+// Value is kept in relaxed atomic words, so the torn copies readers discard are not data races
+template<class ValueClass>
+class SeqLock final
+{
+    static_assert(std::is_trivially_copyable_v<ValueClass>, "value is copied byte by byte, it has to be trivially copyable");
+    static_assert(std::is_default_constructible_v<ValueClass>, "value is copied into a default constructed one");
+
+public:
+    SeqLock() = default;
+
+    explicit SeqLock(const ValueClass& value)
+    {
+        StoreWords(value);
+    }
+
+    // Only one thread may store at a time
+    void Store(const ValueClass& value);
+
+    // Returns the last stored value
+    ValueClass Load() const;
+
+    // Single attempt, fails when the writer is storing a new value. Doesn't spin
+    bool TryLoad(ValueClass& value) const;
+
+    // Count of finished stores, could be compared by readers to tell a new value
+    uint64_t GetVersion() const
+    {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+    SeqLock(const SeqLock& other) = delete;
+    SeqLock& operator=(const SeqLock& other) = delete;
+
+private:
+    using Word = uint64_t;
+    static constexpr size_t kWordsCount = (sizeof(ValueClass) + sizeof(Word) - 1) / sizeof(Word);
+
+    void StoreWords(const ValueClass& value);
+    // Reads the value between two sequence loads, returns false if the writer interfered
+    bool TryLoadWords(ValueClass& value) const;
+
+    // Odd while the writer is storing. The words follow it in the same aligned block, so a reader of a small value
+    // touches one cache line, and unrelated neighbouring data doesn't share it
+    alignas(64) std::atomic_uint64_t sequence = 0;
+    std::atomic<Word> words[kWordsCount] = {};
+
+    static_assert(std::atomic<Word>::is_always_lock_free, "atomic 64-bit words are not lock free, need to use other type");
+};
+
+template<class ValueClass>
+inline void SeqLock<ValueClass>::StoreWords(const ValueClass& value)
+{
+    Word buffer[kWordsCount] = {};
+    std::memcpy(buffer, &value, sizeof(ValueClass));
+    for(size_t i = 0; i < kWordsCount; ++i)
+        words[i].store(buffer[i], std::memory_order_relaxed);
+}
+
+template<class ValueClass>
+inline bool SeqLock<ValueClass>::TryLoadWords(ValueClass& value) const
+{
+    const uint64_t start_sequence = sequence.load(std::memory_order_acquire);
+    if(start_sequence & 1)
+        return false;
+
+    Word buffer[kWordsCount];
+    for(size_t i = 0; i < kWordsCount; ++i)
+        buffer[i] = words[i].load(std::memory_order_relaxed);
+
+    // Keeps the word loads above the second sequence load
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(sequence.load(std::memory_order_relaxed) != start_sequence)
+        return false;
+
+    std::memcpy(&value, buffer, sizeof(ValueClass));
+    return true;
+}
+
+template<class ValueClass>
+inline void SeqLock<ValueClass>::Store(const ValueClass& value)
+{
+    const uint64_t current_sequence = sequence.load(std::memory_order_relaxed);
+    sequence.store(current_sequence + 1, std::memory_order_relaxed);
+    // Keeps the word stores below the odd sequence, so a reader seeing any of them sees the sequence changed
+    std::atomic_thread_fence(std::memory_order_release);
+    StoreWords(value);
+    sequence.store(current_sequence + 2, std::memory_order_release);
+}
+
+template<class ValueClass>
+inline ValueClass SeqLock<ValueClass>::Load() const
+{
+    ValueClass value;
+    if(TryLoadWords(value))
+        return value;
+
+    SpinBackoff backoff;
+    do
+    {
+        backoff.Pause();
+    }
+    while(!TryLoadWords(value));
+    return value;
+}
+
+template<class ValueClass>
+inline bool SeqLock<ValueClass>::TryLoad(ValueClass& value) const
+{
+    return TryLoadWords(value);
+}
\ No newline at end of file
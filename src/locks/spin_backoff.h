@@ -0,0 +1,61 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Tells the CPU the thread is spinning, so the sibling hyper-thread gets the core and the loop doesn't flood the memory bus
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Exponential backoff for the spin loops. Pauses twice as long on every retry, and yields the thread once the limit is reached,
+// so the waiters don't hammer the lock cache line all at once when it's released
+class SpinBackoff
+{
+public:
+    static constexpr uint32_t kMaxPausesCount = 64;
+
+    void Pause()
+    {
+        if(pauses_count > kMaxPausesCount)
+        {
+            std::this_thread::yield();
+            return;
+        }
+
+        for(uint32_t i = 0; i < pauses_count; ++i)
+            CpuRelax();
+        pauses_count *= 2;
+    }
+
+    void Reset()
+    {
+        pauses_count = 1;
+    }
+
+private:
+    uint32_t pauses_count = 1;
+};
\ No newline at end of file
@@ -16,10 +16,18 @@
 
 #include <thread>
 
-void SpinLock::Acquire()
+void SpinLock::AcquireContended()
 {
-    while(!TryAcquire())
+    // Only the contended path is timed
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    do
     {
         std::this_thread::yield();
+        ++spins_count;
     }
+    while(!TryLock());
+
+    RecordAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
 }
\ No newline at end of file
@@ -18,7 +18,7 @@
 
 #include <atomic>
 
-class SpinLock : public LockBase
+class SpinLock final : public LockBase
 {
 public:
     explicit SpinLock(const optional_sting& name = optional_sting());
@@ -28,6 +28,11 @@ public:
     void Release() override;
 
 protected:
+    // Acquisition attempt without recording it
+    bool TryLock();
+    // Slow path of Acquire, after the first attempt failed
+    void AcquireContended();
+
     std::atomic_flag is_locked;
 };
 
@@ -38,13 +43,37 @@ inline SpinLock::SpinLock(const optional_sting& name)
     is_locked.clear();
 }
 
-inline bool SpinLock::TryAcquire()
+inline bool SpinLock::TryLock()
 {
     const bool is_already_locked = is_locked.test_and_set(std::memory_order_acquire);
     return !is_already_locked;
 }
 
+inline bool SpinLock::TryAcquire()
+{
+    if(!TryLock())
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordAcquired();
+    return true;
+}
+
 inline void SpinLock::Release()
 {
+    RecordReleased();
     is_locked.clear(std::memory_order_release);
+}
+
+inline void SpinLock::Acquire()
+{
+    if(TryLock())
+    {
+        RecordAcquired();
+        return;
+    }
+
+    AcquireContended();
 }
\ No newline at end of file
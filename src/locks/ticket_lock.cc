@@ -0,0 +1,53 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ticket_lock.h"
+
+#include <thread>
+#include "spin_backoff.h"
+
+namespace
+{
+    constexpr uint32_t kPausesPerWaiter = 32;
+    // Waiters further in the queue yield the thread instead of pausing
+    constexpr uint32_t kMaxPausingWaiters = 8;
+    // Waiter which polled that many times yields too, since the owner or the waiters ahead may be preempted
+    constexpr uint64_t kMaxPausingPolls = 4;
+}
+
+void TicketLock::WaitForTicket(uint32_t ticket, uint32_t serving)
+{
+    const bool is_recorded = LockStats::IsEnabled();
+    const auto wait_start = is_recorded ? LockStats::Clock::now() : LockStats::Clock::time_point();
+    uint64_t spins_count = 0;
+    do
+    {
+        const uint32_t waiters_ahead = ticket - serving;
+        if(waiters_ahead > kMaxPausingWaiters || spins_count > kMaxPausingPolls)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            for(uint32_t i = 0; i < waiters_ahead * kPausesPerWaiter; ++i)
+                CpuRelax();
+        }
+
+        ++spins_count;
+        serving = serving_ticket.load(std::memory_order_acquire);
+    }
+    while(serving != ticket);
+
+    RecordAcquired(spins_count, is_recorded ? LockStats::Clock::now() - wait_start : LockStats::Clock::duration::zero());
+}
\ No newline at end of file
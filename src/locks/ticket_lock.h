@@ -0,0 +1,82 @@
+// Copyright 2022 gab
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lock_base.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Fair spin lock, which grants the lock in the order of arrival. Waiters pause in proportion to their place in the queue,
+// so they poll the shared counter less often. A preempted waiter holds up everybody after it, so it's a poor choice for oversubscribed threads
+class TicketLock final : public LockBase
+{
+public:
+    explicit TicketLock(const optional_sting& name = optional_sting());
+
+    bool TryAcquire() override;
+    void Acquire() override;
+    void Release() override;
+
+protected:
+    static constexpr size_t kCacheLineSize = 64;
+
+    // Slow path of Acquire, when the ticket isn't served yet
+    void WaitForTicket(uint32_t ticket, uint32_t serving);
+
+    // Counters are on separate lines, so taking a ticket doesn't invalidate the line the waiters spin on
+    alignas(kCacheLineSize) std::atomic_uint32_t next_ticket = 0;
+    alignas(kCacheLineSize) std::atomic_uint32_t serving_ticket = 0;
+};
+
+inline TicketLock::TicketLock(const optional_sting& name)
+: LockBase(name)
+{
+    lock_class_name = "TicketLock";
+}
+
+inline bool TicketLock::TryAcquire()
+{
+    // Succeeds only when nobody holds or waits for the lock. Acquire load pairs with the release of the previous owner
+    uint32_t ticket = serving_ticket.load(std::memory_order_acquire);
+    if(!next_ticket.compare_exchange_strong(ticket, ticket + 1, std::memory_order_relaxed))
+    {
+        RecordTryAcquireFailed();
+        return false;
+    }
+
+    RecordAcquired();
+    return true;
+}
+
+inline void TicketLock::Release()
+{
+    RecordReleased();
+    // Only the owner changes the serving ticket
+    serving_ticket.store(serving_ticket.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+inline void TicketLock::Acquire()
+{
+    const uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+    const uint32_t serving = serving_ticket.load(std::memory_order_acquire);
+    if(serving == ticket)
+    {
+        RecordAcquired();
+        return;
+    }
+
+    WaitForTicket(ticket, serving);
+}
\ No newline at end of file
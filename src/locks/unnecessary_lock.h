@@ -17,7 +17,7 @@
 #include "lock_base.h"
 #include <cassert>
 
-class UnnecessaryLock : public LockBase
+class UnnecessaryLock final : public LockBase
 {
 public:
     explicit UnnecessaryLock(const optional_sting& name);
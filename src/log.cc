@@ -16,6 +16,7 @@
 
 #include "log.h"
 
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <cstdarg>
@@ -25,7 +26,8 @@
 
 static const unsigned kMaxLogStrLength = 512;
 // Bit mask for filtering log messages
-static const unsigned kLogLevelFilter = ~0u;
+static std::atomic_uint log_level_filter = ~0u;
+static std::atomic<FILE*> log_output = nullptr;
 
 
 static const char* log_level_description(SurfaceppLogLevel level)
@@ -105,7 +107,7 @@ static void build_log_format(char * log_format, size_t length, SurfaceppLogLevel
 
 void _log (SurfaceppLogLevel level, const char * requested_format, ...)
 {
-    if((level & kLogLevelFilter) == 0)
+    if((level & log_level_filter.load(std::memory_order_relaxed)) == 0)
         return;
 
     va_list args;
@@ -114,7 +116,8 @@ void _log (SurfaceppLogLevel level, const char * requested_format, ...)
     build_log_format(log_format, kMaxLogStrLength, level, requested_format);
 
     va_start(args, requested_format);
-    vfprintf(stdout, log_format, args);
+    FILE* output = log_output.load(std::memory_order_relaxed);
+    vfprintf(output ? output : stdout, log_format, args);
     va_end(args);
 }
 
@@ -144,5 +147,16 @@ void GLAPIENTRY _glMessageCallback(GLenum source, GLenum type, GLuint id, GLenum
 
 void _flush_log()
 {
-    fflush(stdout);
+    FILE* output = log_output.load(std::memory_order_relaxed);
+    fflush(output ? output : stdout);
+}
+
+void SetLogLevelFilter(unsigned level_filter)
+{
+    log_level_filter.store(level_filter, std::memory_order_relaxed);
+}
+
+void SetLogOutput(FILE* output)
+{
+    log_output.store(output, std::memory_order_relaxed);
 }
\ No newline at end of file
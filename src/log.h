@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cstdio>
 #include "glad/glad.h"
 
 // Log levels
@@ -35,6 +36,12 @@ void GLAPIENTRY _glMessageCallback(GLenum source, GLenum type, GLuint id, GLenum
 
 void _flush_log();
 
+// Messages of the levels not in the mask are dropped. All levels are logged by default
+void SetLogLevelFilter(unsigned level_filter);
+
+// Stream the messages are written to, stdout by default
+void SetLogOutput(FILE* output);
+
 
 #define log_err(...) \
     _log (kSurfaceppLogLevelErr, __VA_ARGS__)
@@ -18,6 +18,8 @@
 #include <GLFW/glfw3.h>
 
 #include "scene/scene_serializer.h"
+#include "jobs/frame_arena.h"
+#include "jobs/task_manager.h"
 
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 950;
@@ -46,6 +48,8 @@ namespace surfacepp {
         window_ = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Surface++ Editor", nullptr, nullptr);
         assert(window_ != nullptr);
         glfwMakeContextCurrent(window_);
+        // GPU uploads from the worker tasks are posted back to the thread owning the context
+        TaskManager::GetInstance().BindMainThread();
 
         glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 
@@ -191,6 +195,9 @@ namespace surfacepp {
             lastFrame = currentFrame;
 
             glfwPollEvents();
+            FrameArena::BeginFrame();
+            TaskManager::GetInstance().BeginFrame();
+            TaskManager::GetInstance().ExecuteMainThreadTasks();
             this->OnUpdate(deltaTime);
             this->OnOpenglRender(deltaTime);
             this->gui_->onRender();